@@ -0,0 +1,314 @@
+/*
+  Benchmark for the ArduinoHttpStream library.
+  Times how long HttpStream and WebSocketStream take to parse responses
+  and build requests, using MockStream, which replays a canned response
+  from memory, so no network or server is needed and the numbers are just
+  for the library.
+
+  Change kBodyLength, kFragmentSize and kLatencyMicros to see how it copes
+  with bigger bodies, or with the response arriving a few bytes at a time.
+  HttpStream is given an HttpYieldClock, so when a fragment hasn't arrived
+  yet it polls rather than sleeping for a few milliseconds, which would
+  swamp the timings.
+
+  It also builds for a PC, where it counts heap allocations as well:
+  make -C extras/host bench
+
+  this example is in the public domain
+*/
+
+#include <ArduinoHttpStream.h>
+#include "MockStream.h"
+
+// Only the host build has this, to hook malloc()
+#if defined(__has_include)
+#if __has_include("AllocationCounter.h")
+#include "AllocationCounter.h"
+#define COUNT_ALLOCATIONS
+#endif
+#endif
+
+// Length of the response body.  Keep it small on boards with little RAM
+#if defined(__AVR__)
+const unsigned int kBodyLength = 256;
+#else
+const unsigned int kBodyLength = 4096;
+#endif
+// Size of the chunks when the body is sent chunked
+const unsigned int kChunkSize = 128;
+// Length of each WebSocket message
+const unsigned int kMessageLength = 125;
+// Most bytes available() will report at once, 0 for all of them
+const unsigned int kFragmentSize = 0;
+// How long each fragment takes to "arrive", in microseconds
+const unsigned long kLatencyMicros = 0;
+// How many times to run each test
+const int kIterations = 100;
+
+const char kHeaders[] =
+  "HTTP/1.1 200 OK\r\n"
+  "Date: Mon, 27 Jul 2020 12:28:53 GMT\r\n"
+  "Server: Apache/2.4.41 (Unix)\r\n"
+  "Last-Modified: Wed, 22 Jul 2020 19:15:56 GMT\r\n"
+  "ETag: \"34aa387-d-1568eb00\"\r\n"
+  "Accept-Ranges: bytes\r\n"
+  "Vary: Accept-Encoding\r\n"
+  "Cache-Control: max-age=3600\r\n"
+  "Content-Type: application/octet-stream\r\n";
+
+const char kUpgrade[] =
+  "HTTP/1.1 101 Switching Protocols\r\n"
+  "Upgrade: websocket\r\n"
+  "Connection: Upgrade\r\n"
+  "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"
+  "\r\n";
+
+// Space for the headers and a chunked body, with its framing
+uint8_t response[sizeof(kHeaders) + 64 + kBodyLength + (kBodyLength / kChunkSize + 1) * 8];
+uint8_t block[64];
+MockStream mock;
+HttpStream http(mock);
+HttpYieldClock yieldClock;
+
+// Time, and on the host allocations, for one of the tests as it runs
+class Measurement {
+public:
+  Measurement() : iMicros(0), iAllocations(0) {}
+
+  void start() {
+#ifdef COUNT_ALLOCATIONS
+    iCounter = AllocationCounter();
+#endif
+    iStart = micros();
+  }
+
+  void stop() {
+    iMicros += micros() - iStart;
+#ifdef COUNT_ALLOCATIONS
+    iAllocations += iCounter.count();
+#endif
+  }
+
+  void report(const char* aName, unsigned long aBytes) {
+    Serial.print(aName);
+    Serial.print(": ");
+    Serial.print((float)iMicros / kIterations);
+    Serial.print(" us each");
+    if (aBytes && iMicros) {
+      Serial.print(", ");
+      Serial.print((iMicros * 1000.0) / aBytes);
+      Serial.print(" ns/byte, ");
+      Serial.print((aBytes * 1000000.0) / iMicros / 1024.0);
+      Serial.print(" KB/s");
+    }
+#ifdef COUNT_ALLOCATIONS
+    Serial.print(", ");
+    Serial.print((float)iAllocations / kIterations);
+    Serial.print(" allocations each");
+#endif
+    Serial.println();
+  }
+
+private:
+#ifdef COUNT_ALLOCATIONS
+  AllocationCounter iCounter;
+#endif
+  unsigned long iStart;
+  unsigned long iMicros;
+  unsigned long iAllocations;
+};
+
+// Build the canned response, returning its length
+size_t buildResponse(bool aChunked) {
+  String framing;
+  size_t length = 0;
+
+  memcpy(response, kHeaders, sizeof(kHeaders) - 1);
+  length += sizeof(kHeaders) - 1;
+  if (aChunked) {
+    framing = "Transfer-Encoding: chunked\r\n\r\n";
+  } else {
+    framing = String("Content-Length: ") + kBodyLength + "\r\n\r\n";
+  }
+  memcpy(response + length, framing.c_str(), framing.length());
+  length += framing.length();
+
+  for (unsigned int i = 0; i < kBodyLength; i++) {
+    if (aChunked && ((i % kChunkSize) == 0)) {
+      unsigned int chunk = min(kChunkSize, kBodyLength - i);
+      framing = i ? "\r\n" : "";
+      framing += String(chunk, HEX);
+      framing += "\r\n";
+      memcpy(response + length, framing.c_str(), framing.length());
+      length += framing.length();
+    }
+    response[length++] = 'a' + (i % 26);
+  }
+  if (aChunked) {
+    memcpy(response + length, "\r\n0\r\n\r\n", 7);
+    length += 7;
+  }
+  return length;
+}
+
+// Build a WebSocket upgrade followed by unmasked text messages, as a server
+// would send them, returning its length
+size_t buildMessages() {
+  size_t length = sizeof(kUpgrade) - 1;
+
+  memcpy(response, kUpgrade, length);
+  while (length + 2 + kMessageLength <= sizeof(response)) {
+    response[length++] = 0x80 | TYPE_TEXT;
+    response[length++] = kMessageLength;
+    for (unsigned int i = 0; i < kMessageLength; i++) {
+      response[length++] = 'a' + (i % 26);
+    }
+  }
+  return length;
+}
+
+// Start reading the canned response from the beginning
+void startResponse() {
+  mock.rewind();
+  http.resetState();
+  http.get("/");
+}
+
+void headerCallback(const char*, size_t, const char*, size_t, void*) {
+}
+
+void benchmarkHeaders(size_t aLength) {
+  unsigned long headerBytes = (aLength - kBodyLength) * (unsigned long)kIterations;
+  Measurement status;
+  Measurement skip;
+  Measurement visit;
+
+  for (int i = 0; i < kIterations; i++) {
+    startResponse();
+    status.start();
+    http.responseStatusCode();
+    status.stop();
+    skip.start();
+    http.skipResponseHeaders();
+    skip.stop();
+  }
+  status.report("Status line", 0);
+  skip.report("Headers", headerBytes);
+
+  char line[64];
+
+  for (int i = 0; i < kIterations; i++) {
+    startResponse();
+    visit.start();
+    http.readHeaders(line, sizeof(line), headerCallback);
+    visit.stop();
+  }
+  visit.report("Headers with readHeaders()", headerBytes);
+}
+
+void benchmarkBody(const char* aName) {
+  Measurement body;
+
+  for (int i = 0; i < kIterations; i++) {
+    startResponse();
+    http.skipResponseHeaders();
+    body.start();
+    while (http.readBytes(block, sizeof(block)) > 0) {
+    }
+    body.stop();
+  }
+  body.report(aName, (unsigned long)kBodyLength * kIterations);
+}
+
+void benchmarkRequest() {
+  Measurement request;
+  unsigned long writes = 0;
+
+  for (int i = 0; i < kIterations; i++) {
+    mock.rewind();
+    http.resetState();
+    request.start();
+    http.beginRequest();
+    http.post("/api/v1/readings");
+    http.sendHeader("Host", "example.com");
+    http.sendHeader("User-Agent", "Arduino/2.2.0");
+    http.sendHeader("Content-Type", "application/json");
+    http.sendHeader("Content-Length", 13);
+    http.beginBody();
+    http.print("{\"value\":42}\n");
+    http.endRequest();
+    request.stop();
+    writes += mock.iWrites;
+  }
+  request.report("Request", mock.iWritten * kIterations);
+  Serial.print("  writes per request: ");
+  Serial.println((float)writes / kIterations);
+}
+
+void benchmarkWebSocket() {
+  WebSocketStream ws(mock);
+  Measurement receive;
+  Measurement send;
+  unsigned long received = 0;
+
+  ws.setClock(&yieldClock);
+  for (int i = 0; i < kIterations; i++) {
+    mock.rewind();
+    ws.resetState();
+    ws.begin("/");
+    receive.start();
+    while (ws.parseMessage() > 0) {
+      // Only ask for what's left of this message, so the read doesn't run
+      // on into the next one
+      while (ws.available() > 0) {
+        received += ws.read(block, min(sizeof(block), (size_t)ws.available()));
+      }
+    }
+    receive.stop();
+  }
+  receive.report("WebSocket messages", received);
+
+  uint8_t message[kMessageLength];
+
+  memset(message, 'a', sizeof(message));
+  for (int i = 0; i < kIterations; i++) {
+    mock.rewind();
+    send.start();
+    ws.beginMessage(TYPE_TEXT);
+    ws.write(message, sizeof(message));
+    ws.endMessage();
+    send.stop();
+  }
+  send.report("WebSocket send", (unsigned long)sizeof(message) * kIterations);
+}
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+
+  Serial.println("Benchmarking HttpStream");
+  mock.setFragments(kFragmentSize, kLatencyMicros);
+  http.setClock(&yieldClock);
+
+  size_t length = buildResponse(false);
+  mock.setData(response, length);
+  benchmarkHeaders(length);
+  benchmarkBody("Content-Length body");
+
+  length = buildResponse(true);
+  mock.setData(response, length);
+  benchmarkBody("Chunked body");
+
+  benchmarkRequest();
+
+  // parseMessage() gives 0 until a frame's header has arrived, which would
+  // end the loop early, so the messages arrive all at once
+  length = buildMessages();
+  mock.setData(response, length);
+  mock.setFragments(0);
+  benchmarkWebSocket();
+  Serial.println("Done");
+}
+
+void loop() {
+}
@@ -0,0 +1,115 @@
+// Stream which replays a canned response, for the Benchmark example and the
+// tests in extras/host
+// Released under Apache License, version 2.0
+
+#ifndef MockStream_h
+#define MockStream_h
+
+#include <Arduino.h>
+
+// Hands over a response from memory, optionally a few bytes at a time with
+// a delay before each fragment "arrives", as if it were coming over a slow
+// network.  Whatever is written to it is kept, up to the size of the
+// buffer given to setOutput(), and counted.  Once the response has all been
+// read it acts like a connection that has stalled, with nothing available
+class MockStream : public Stream
+{
+public:
+    MockStream()
+     : iData(NULL), iLength(0), iFragmentSize(0), iLatencyMicros(0),
+       iOutput(NULL), iOutputSize(0)
+      { rewind(); };
+
+    /** Set the response to replay, which must stay around whilst it's used
+    */
+    void setData(const uint8_t* aData, size_t aLength) { iData = aData; iLength = aLength; rewind(); };
+    void setData(const char* aData) { setData((const uint8_t*)aData, strlen(aData)); };
+
+    /** Hand the response over aFragmentSize bytes at a time, 0 for all of
+      it at once, each fragment arriving aLatencyMicros after the last one
+      was used up
+    */
+    void setFragments(size_t aFragmentSize, unsigned long aLatencyMicros = 0)
+      { iFragmentSize = aFragmentSize; iLatencyMicros = aLatencyMicros; };
+
+    /** Keep what's written in aBuffer, up to aSize bytes
+    */
+    void setOutput(uint8_t* aBuffer, size_t aSize) { iOutput = aBuffer; iOutputSize = aSize; rewind(); };
+
+    /** Start the response again, and forget what's been written
+    */
+    void rewind()
+      { iPos = 0; iFragmentEnd = 0; iFragmentStart = micros(); iWrites = 0; iWritten = 0; };
+
+    /** Return how much of the response is left to read
+    */
+    size_t remaining() { return iLength - iPos; };
+
+    // Inherited from Stream
+    virtual int available()
+    {
+        if (iPos == iFragmentEnd)
+        {
+            // Start the next fragment once it has had time to arrive
+            if ((micros() - iFragmentStart) < iLatencyMicros)
+            {
+                return 0;
+            }
+            iFragmentEnd = iFragmentSize ? iPos + iFragmentSize : iLength;
+            if (iFragmentEnd > iLength)
+            {
+                iFragmentEnd = iLength;
+            }
+        }
+        return iFragmentEnd - iPos;
+    };
+    virtual int read()
+    {
+        if (!available())
+        {
+            return -1;
+        }
+
+        int c = iData[iPos++];
+
+        if (iPos == iFragmentEnd)
+        {
+            iFragmentStart = micros();
+        }
+        return c;
+    };
+    virtual int peek() { return available() ? iData[iPos] : -1; };
+    virtual void flush() {};
+
+    // Inherited from Print
+    virtual size_t write(uint8_t c) { return write(&c, 1); };
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize)
+    {
+        if (iOutput && (iWritten < iOutputSize))
+        {
+            size_t toCopy = iOutputSize - iWritten;
+
+            memcpy(iOutput + iWritten, aBuffer, (aSize < toCopy) ? aSize : toCopy);
+        }
+        iWrites++;
+        iWritten += aSize;
+        return aSize;
+    };
+
+    // Number of calls to write(), and the bytes written
+    unsigned long iWrites;
+    size_t iWritten;
+
+protected:
+    const uint8_t* iData;
+    size_t iLength;
+    size_t iPos;
+    size_t iFragmentSize;
+    unsigned long iLatencyMicros;
+    size_t iFragmentEnd;
+    unsigned long iFragmentStart;
+    uint8_t* iOutput;
+    size_t iOutputSize;
+};
+
+#endif
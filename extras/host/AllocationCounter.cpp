@@ -0,0 +1,45 @@
+// Counts heap allocations, for the benchmark
+// Released under Apache License, version 2.0
+
+#include "AllocationCounter.h"
+
+// What glibc's own malloc() and friends call, so we can wrap them without
+// needing dlsym()
+extern "C" void* __libc_malloc(size_t aSize);
+extern "C" void* __libc_calloc(size_t aCount, size_t aSize);
+extern "C" void* __libc_realloc(void* aPointer, size_t aSize);
+
+static unsigned long gAllocations = 0;
+static unsigned long long gAllocatedBytes = 0;
+
+extern "C" void* malloc(size_t aSize)
+{
+    gAllocations++;
+    gAllocatedBytes += aSize;
+    return __libc_malloc(aSize);
+}
+
+extern "C" void* calloc(size_t aCount, size_t aSize)
+{
+    gAllocations++;
+    gAllocatedBytes += aCount * aSize;
+    return __libc_calloc(aCount, aSize);
+}
+
+extern "C" void* realloc(void* aPointer, size_t aSize)
+{
+    // Growing a String in place still counts, as it might not have been
+    gAllocations++;
+    gAllocatedBytes += aSize;
+    return __libc_realloc(aPointer, aSize);
+}
+
+unsigned long AllocationCounter::allocations()
+{
+    return gAllocations;
+}
+
+unsigned long long AllocationCounter::allocatedBytes()
+{
+    return gAllocatedBytes;
+}
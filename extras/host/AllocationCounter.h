@@ -0,0 +1,38 @@
+// Counts heap allocations, for the benchmark
+// Released under Apache License, version 2.0
+
+#ifndef AllocationCounter_h
+#define AllocationCounter_h
+
+#include <stddef.h>
+
+// Linking AllocationCounter.cpp replaces malloc() and friends with versions
+// which count the calls before handing them on to glibc, so everything is
+// counted, including new and what the C++ library does.  Linux only
+class AllocationCounter
+{
+public:
+    /** Start counting from now
+    */
+    AllocationCounter() : iStart(allocations()), iStartBytes(allocatedBytes()) {};
+
+    /** Return the number of allocations since this was created
+    */
+    unsigned long count() const { return allocations() - iStart; };
+
+    /** Return the number of bytes asked for since this was created
+    */
+    unsigned long long bytes() const { return allocatedBytes() - iStartBytes; };
+
+    /** Return the number of calls to malloc(), calloc() and realloc() since
+      the program started
+    */
+    static unsigned long allocations();
+    static unsigned long long allocatedBytes();
+
+protected:
+    unsigned long iStart;
+    unsigned long long iStartBytes;
+};
+
+#endif
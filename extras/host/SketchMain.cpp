@@ -0,0 +1,13 @@
+// Runs an Arduino sketch on the host, as the core would: setup() once, then
+// loop(), which for the Benchmark example has nothing left to do
+// Released under Apache License, version 2.0
+
+void setup();
+void loop();
+
+int main()
+{
+    setup();
+    loop();
+    return 0;
+}
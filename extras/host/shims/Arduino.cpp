@@ -0,0 +1,66 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host
+// Released under Apache License, version 2.0
+
+#include "Arduino.h"
+#include <time.h>
+
+HostSerial Serial;
+
+static unsigned long long monotonicMicros()
+{
+    static unsigned long long start = 0;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    unsigned long long micros = (unsigned long long)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+
+    if (start == 0)
+    {
+        start = micros;
+    }
+    return micros - start;
+}
+
+unsigned long millis()
+{
+    return monotonicMicros() / 1000;
+}
+
+unsigned long micros()
+{
+    return monotonicMicros();
+}
+
+void delay(unsigned long aMillis)
+{
+    struct timespec wait = { (time_t)(aMillis / 1000), (long)(aMillis % 1000) * 1000000L };
+
+    nanosleep(&wait, NULL);
+}
+
+void delayMicroseconds(unsigned int aMicros)
+{
+    struct timespec wait = { (time_t)(aMicros / 1000000), (long)(aMicros % 1000000) * 1000L };
+
+    nanosleep(&wait, NULL);
+}
+
+void yield()
+{
+}
+
+long random(long aMax)
+{
+    return (aMax > 0) ? (rand() % aMax) : 0;
+}
+
+long random(long aMin, long aMax)
+{
+    return (aMax > aMin) ? aMin + random(aMax - aMin) : aMin;
+}
+
+void randomSeed(unsigned long aSeed)
+{
+    srand(aSeed);
+}
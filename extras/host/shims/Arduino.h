@@ -0,0 +1,70 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host, for
+// the tests and the benchmark.  Not a general purpose replacement for it
+// Released under Apache License, version 2.0
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Everything is in RAM
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long aMillis);
+void delayMicroseconds(unsigned int aMicros);
+void yield();
+
+long random(long aMax);
+long random(long aMin, long aMax);
+void randomSeed(unsigned long aSeed);
+
+inline bool isAlphaNumeric(int c) { return isalnum(c); }
+inline bool isAlpha(int c) { return isalpha(c); }
+inline bool isDigit(int c) { return isdigit(c); }
+inline bool isHexadecimalDigit(int c) { return isxdigit(c); }
+inline bool isSpace(int c) { return isspace(c); }
+inline bool isWhitespace(int c) { return (c == ' ') || (c == '\t'); }
+inline bool isUpperCase(int c) { return isupper(c); }
+inline bool isLowerCase(int c) { return islower(c); }
+
+// Functions rather than the core's macros, so they don't upset the C++
+// standard library
+template<class T, class U> inline T min(T a, U b) { return (b < a) ? b : a; }
+template<class T, class U> inline T max(T a, U b) { return (a < b) ? b : a; }
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+
+// Serial writes to stdout and never has anything to read
+class HostSerial : public Stream
+{
+public:
+    void begin(unsigned long) {};
+    void end() {};
+    virtual size_t write(uint8_t c) { return fwrite(&c, 1, 1, stdout); };
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize) { return fwrite(aBuffer, 1, aSize, stdout); };
+    virtual int available() { return 0; };
+    virtual int read() { return -1; };
+    virtual int peek() { return -1; };
+    virtual void flush() { fflush(stdout); };
+    operator bool() { return true; };
+};
+
+extern HostSerial Serial;
+
+#endif
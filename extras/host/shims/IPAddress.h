@@ -0,0 +1,24 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host
+// Released under Apache License, version 2.0
+
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <Arduino.h>
+
+class IPAddress
+{
+public:
+    IPAddress() { memset(iAddress, 0, sizeof(iAddress)); };
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      { iAddress[0] = a; iAddress[1] = b; iAddress[2] = c; iAddress[3] = d; };
+
+    uint8_t operator[](int aIndex) const { return iAddress[aIndex]; };
+    uint8_t& operator[](int aIndex) { return iAddress[aIndex]; };
+    bool operator==(const IPAddress& aOther) const { return !memcmp(iAddress, aOther.iAddress, sizeof(iAddress)); };
+
+protected:
+    uint8_t iAddress[4];
+};
+
+#endif
@@ -0,0 +1,65 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host
+// Released under Apache License, version 2.0
+
+#include "Arduino.h"
+
+size_t Print::write(const uint8_t* aBuffer, size_t aSize)
+{
+    size_t written = 0;
+
+    while (aSize--)
+    {
+        if (!write(*aBuffer++))
+        {
+            break;
+        }
+        written++;
+    }
+    return written;
+}
+
+size_t Print::print(long aValue, int aBase)
+{
+    return print((long long)aValue, aBase);
+}
+
+size_t Print::print(unsigned long aValue, int aBase)
+{
+    return print((unsigned long long)aValue, aBase);
+}
+
+size_t Print::print(long long aValue, int aBase)
+{
+    if ((aValue < 0) && (aBase == DEC))
+    {
+        return print('-') + print(0ULL - (unsigned long long)aValue, aBase);
+    }
+    return print((unsigned long long)aValue, aBase);
+}
+
+size_t Print::print(unsigned long long aValue, int aBase)
+{
+    char digits[65];
+    char* start = digits + sizeof(digits);
+
+    if (aBase < 2)
+    {
+        aBase = DEC;
+    }
+    do
+    {
+        int digit = aValue % aBase;
+
+        *--start = (digit < 10) ? '0' + digit : 'A' + digit - 10;
+        aValue /= aBase;
+    } while (aValue);
+    return write((const uint8_t*)start, digits + sizeof(digits) - start);
+}
+
+size_t Print::print(double aValue, int aDigits)
+{
+    char text[64];
+
+    snprintf(text, sizeof(text), "%.*f", aDigits, aValue);
+    return write(text);
+}
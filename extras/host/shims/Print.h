@@ -0,0 +1,46 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host
+// Released under Apache License, version 2.0
+
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print
+{
+public:
+    virtual ~Print() {};
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize);
+    size_t write(const char* aText) { return aText ? write((const uint8_t*)aText, strlen(aText)) : 0; };
+    size_t write(const char* aBuffer, size_t aSize) { return write((const uint8_t*)aBuffer, aSize); };
+    virtual int availableForWrite() { return 0; };
+    virtual void flush() {};
+
+    size_t print(const char* aText) { return write(aText); };
+    size_t print(const String& aText) { return write((const uint8_t*)aText.c_str(), aText.length()); };
+    size_t print(char c) { return write((uint8_t)c); };
+    size_t print(unsigned char aValue, int aBase = DEC) { return print((unsigned long)aValue, aBase); };
+    size_t print(int aValue, int aBase = DEC) { return print((long)aValue, aBase); };
+    size_t print(unsigned int aValue, int aBase = DEC) { return print((unsigned long)aValue, aBase); };
+    size_t print(long aValue, int aBase = DEC);
+    size_t print(unsigned long aValue, int aBase = DEC);
+    size_t print(long long aValue, int aBase = DEC);
+    size_t print(unsigned long long aValue, int aBase = DEC);
+    size_t print(double aValue, int aDigits = 2);
+
+    size_t println() { return write("\r\n"); };
+    template<class T> size_t println(const T& aValue) { size_t n = print(aValue); return n + println(); };
+    template<class T> size_t println(const T& aValue, int aFormat) { size_t n = print(aValue, aFormat); return n + println(); };
+};
+
+#endif
@@ -0,0 +1,53 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host
+// Released under Apache License, version 2.0
+
+#include "Arduino.h"
+
+int Stream::timedRead()
+{
+    _startMillis = millis();
+    do
+    {
+        int c = read();
+
+        if (c >= 0)
+        {
+            return c;
+        }
+        yield();
+    } while ((millis() - _startMillis) < _timeout);
+    return -1;
+}
+
+int Stream::timedPeek()
+{
+    _startMillis = millis();
+    do
+    {
+        int c = peek();
+
+        if (c >= 0)
+        {
+            return c;
+        }
+        yield();
+    } while ((millis() - _startMillis) < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char* aBuffer, size_t aLength)
+{
+    size_t count = 0;
+
+    while (count < aLength)
+    {
+        int c = timedRead();
+
+        if (c < 0)
+        {
+            break;
+        }
+        aBuffer[count++] = (char)c;
+    }
+    return count;
+}
@@ -0,0 +1,35 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host
+// Released under Apache License, version 2.0
+
+#ifndef Stream_h
+#define Stream_h
+
+#include "Print.h"
+
+class Stream : public Print
+{
+public:
+    Stream() : _timeout(1000), _startMillis(0) {};
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long aTimeout) { _timeout = aTimeout; };
+    unsigned long getTimeout() { return _timeout; };
+
+    /** Read up to aLength bytes, waiting up to the timeout for each of them
+      @return Number of bytes read
+    */
+    size_t readBytes(char* aBuffer, size_t aLength);
+    size_t readBytes(uint8_t* aBuffer, size_t aLength) { return readBytes((char*)aBuffer, aLength); };
+
+protected:
+    int timedRead();
+    int timedPeek();
+
+    unsigned long _timeout;
+    unsigned long _startMillis;
+};
+
+#endif
@@ -0,0 +1,294 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host
+// Released under Apache License, version 2.0
+
+#include "Arduino.h"
+
+String::String(const char* aText)
+ : iBuffer(NULL), iCapacity(0), iLength(0)
+{
+    if (aText)
+    {
+        copy(aText, strlen(aText));
+    }
+}
+
+String::String(const String& aOther)
+ : iBuffer(NULL), iCapacity(0), iLength(0)
+{
+    if (aOther.iBuffer)
+    {
+        copy(aOther.iBuffer, aOther.iLength);
+    }
+}
+
+String::String(String&& aOther)
+ : iBuffer(aOther.iBuffer), iCapacity(aOther.iCapacity), iLength(aOther.iLength)
+{
+    aOther.iBuffer = NULL;
+    aOther.iCapacity = 0;
+    aOther.iLength = 0;
+}
+
+String::String(char c)
+ : iBuffer(NULL), iCapacity(0), iLength(0)
+{
+    copy(&c, 1);
+}
+
+String::String(unsigned char aValue, unsigned char aBase)
+ : String((unsigned long)aValue, aBase)
+{
+}
+
+String::String(int aValue, unsigned char aBase)
+ : String((long)aValue, aBase)
+{
+}
+
+String::String(unsigned int aValue, unsigned char aBase)
+ : String((unsigned long)aValue, aBase)
+{
+}
+
+String::String(long aValue, unsigned char aBase)
+ : iBuffer(NULL), iCapacity(0), iLength(0)
+{
+    char text[66];
+
+    if ((aValue < 0) && (aBase == 10))
+    {
+        snprintf(text, sizeof(text), "%ld", aValue);
+        copy(text, strlen(text));
+    }
+    else
+    {
+        *this = String((unsigned long)aValue, aBase);
+    }
+}
+
+String::String(unsigned long aValue, unsigned char aBase)
+ : iBuffer(NULL), iCapacity(0), iLength(0)
+{
+    char digits[65];
+    char* start = digits + sizeof(digits);
+
+    if (aBase < 2)
+    {
+        aBase = 10;
+    }
+    do
+    {
+        int digit = aValue % aBase;
+
+        // The core uses lower case for hex
+        *--start = (digit < 10) ? '0' + digit : 'a' + digit - 10;
+        aValue /= aBase;
+    } while (aValue);
+    copy(start, digits + sizeof(digits) - start);
+}
+
+String::~String()
+{
+    free(iBuffer);
+}
+
+String& String::operator=(const String& aOther)
+{
+    if (this != &aOther)
+    {
+        if (aOther.iBuffer)
+        {
+            copy(aOther.iBuffer, aOther.iLength);
+        }
+        else
+        {
+            invalidate();
+        }
+    }
+    return *this;
+}
+
+String& String::operator=(String&& aOther)
+{
+    if (this != &aOther)
+    {
+        free(iBuffer);
+        iBuffer = aOther.iBuffer;
+        iCapacity = aOther.iCapacity;
+        iLength = aOther.iLength;
+        aOther.iBuffer = NULL;
+        aOther.iCapacity = 0;
+        aOther.iLength = 0;
+    }
+    return *this;
+}
+
+String& String::operator=(const char* aText)
+{
+    if (aText)
+    {
+        copy(aText, strlen(aText));
+    }
+    else
+    {
+        invalidate();
+    }
+    return *this;
+}
+
+unsigned char String::reserve(unsigned int aSize)
+{
+    if (iBuffer && (iCapacity >= aSize))
+    {
+        return 1;
+    }
+
+    char* buffer = (char*)realloc(iBuffer, aSize + 1);
+
+    if (!buffer)
+    {
+        return 0;
+    }
+    if (!iBuffer)
+    {
+        buffer[0] = '\0';
+    }
+    iBuffer = buffer;
+    iCapacity = aSize;
+    return 1;
+}
+
+unsigned char String::concat(const char* aText)
+{
+    return aText ? concat(aText, strlen(aText)) : 0;
+}
+
+unsigned char String::concat(const char* aText, unsigned int aLength)
+{
+    if (!aText || !reserve(iLength + aLength))
+    {
+        return 0;
+    }
+    memcpy(iBuffer + iLength, aText, aLength);
+    iLength += aLength;
+    iBuffer[iLength] = '\0';
+    return 1;
+}
+
+bool String::equals(const char* aText) const
+{
+    return !strcmp(c_str(), aText ? aText : "");
+}
+
+int String::indexOf(char c, unsigned int aFrom) const
+{
+    if (aFrom >= iLength)
+    {
+        return -1;
+    }
+
+    const char* found = (const char*)memchr(iBuffer + aFrom, c, iLength - aFrom);
+
+    return found ? found - iBuffer : -1;
+}
+
+int String::indexOf(const char* aText, unsigned int aFrom) const
+{
+    if (aFrom >= iLength)
+    {
+        return -1;
+    }
+
+    const char* found = strstr(iBuffer + aFrom, aText);
+
+    return found ? found - iBuffer : -1;
+}
+
+bool String::startsWith(const char* aText) const
+{
+    return !strncmp(c_str(), aText, strlen(aText));
+}
+
+String String::substring(unsigned int aFrom, unsigned int aTo) const
+{
+    String result;
+
+    if (aTo > iLength)
+    {
+        aTo = iLength;
+    }
+    if (aFrom < aTo)
+    {
+        result.copy(iBuffer + aFrom, aTo - aFrom);
+    }
+    return result;
+}
+
+long String::toInt() const
+{
+    return strtol(c_str(), NULL, 10);
+}
+
+void String::invalidate()
+{
+    free(iBuffer);
+    iBuffer = NULL;
+    iCapacity = 0;
+    iLength = 0;
+}
+
+void String::copy(const char* aText, unsigned int aLength)
+{
+    if (!reserve(aLength))
+    {
+        invalidate();
+        return;
+    }
+    memmove(iBuffer, aText, aLength);
+    iLength = aLength;
+    iBuffer[iLength] = '\0';
+}
+
+String operator+(const String& aLeft, const String& aRight)
+{
+    String result(aLeft);
+
+    result.concat(aRight);
+    return result;
+}
+
+String operator+(const String& aLeft, const char* aRight)
+{
+    String result(aLeft);
+
+    result.concat(aRight);
+    return result;
+}
+
+String operator+(const String& aLeft, char aRight)
+{
+    String result(aLeft);
+
+    result.concat(aRight);
+    return result;
+}
+
+String operator+(const String& aLeft, int aRight)
+{
+    return aLeft + String(aRight);
+}
+
+String operator+(const String& aLeft, unsigned int aRight)
+{
+    return aLeft + String(aRight);
+}
+
+String operator+(const String& aLeft, long aRight)
+{
+    return aLeft + String(aRight);
+}
+
+String operator+(const String& aLeft, unsigned long aRight)
+{
+    return aLeft + String(aRight);
+}
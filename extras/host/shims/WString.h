@@ -0,0 +1,83 @@
+// Just enough of the Arduino core to build ArduinoHttpStream on a host
+// Released under Apache License, version 2.0
+
+#ifndef WString_h
+#define WString_h
+
+#include <stddef.h>
+
+// Like the core's String, it keeps its text in a buffer from malloc() which
+// grows with realloc(), so the benchmark counts the same allocations.  A
+// String made from NULL, or which couldn't grow, is invalid and tests false
+class String
+{
+public:
+    String(const char* aText = "");
+    String(const String& aOther);
+    String(String&& aOther);
+    explicit String(char c);
+    explicit String(unsigned char aValue, unsigned char aBase = 10);
+    explicit String(int aValue, unsigned char aBase = 10);
+    explicit String(unsigned int aValue, unsigned char aBase = 10);
+    explicit String(long aValue, unsigned char aBase = 10);
+    explicit String(unsigned long aValue, unsigned char aBase = 10);
+    ~String();
+
+    String& operator=(const String& aOther);
+    String& operator=(String&& aOther);
+    String& operator=(const char* aText);
+
+    /** Make sure there's space for aSize characters
+      @return 1 if there is, 0 if it couldn't be allocated
+    */
+    unsigned char reserve(unsigned int aSize);
+    unsigned int length() const { return iLength; };
+    const char* c_str() const { return iBuffer ? iBuffer : ""; };
+    explicit operator bool() const { return iBuffer != NULL; };
+
+    unsigned char concat(const String& aOther) { return concat(aOther.c_str(), aOther.iLength); };
+    unsigned char concat(const char* aText);
+    unsigned char concat(char c) { return concat(&c, 1); };
+    unsigned char concat(int aValue) { return concat(String(aValue)); };
+    unsigned char concat(unsigned int aValue) { return concat(String(aValue)); };
+    unsigned char concat(long aValue) { return concat(String(aValue)); };
+    unsigned char concat(unsigned long aValue) { return concat(String(aValue)); };
+
+    template<class T> String& operator+=(const T& aValue) { concat(aValue); return *this; };
+
+    bool equals(const char* aText) const;
+    bool operator==(const String& aOther) const { return equals(aOther.c_str()); };
+    bool operator==(const char* aText) const { return equals(aText); };
+    bool operator!=(const String& aOther) const { return !equals(aOther.c_str()); };
+    bool operator!=(const char* aText) const { return !equals(aText); };
+
+    char charAt(unsigned int aIndex) const { return (aIndex < iLength) ? iBuffer[aIndex] : 0; };
+    char operator[](unsigned int aIndex) const { return charAt(aIndex); };
+    int indexOf(char c, unsigned int aFrom = 0) const;
+    int indexOf(const char* aText, unsigned int aFrom = 0) const;
+    bool startsWith(const char* aText) const;
+    String substring(unsigned int aFrom) const { return substring(aFrom, iLength); };
+    String substring(unsigned int aFrom, unsigned int aTo) const;
+    long toInt() const;
+
+protected:
+    // Protected, as it is in the AVR core, so the library can't come to
+    // rely on it
+    unsigned char concat(const char* aText, unsigned int aLength);
+    void invalidate();
+    void copy(const char* aText, unsigned int aLength);
+
+    char* iBuffer;
+    unsigned int iCapacity;
+    unsigned int iLength;
+};
+
+String operator+(const String& aLeft, const String& aRight);
+String operator+(const String& aLeft, const char* aRight);
+String operator+(const String& aLeft, char aRight);
+String operator+(const String& aLeft, int aRight);
+String operator+(const String& aLeft, unsigned int aRight);
+String operator+(const String& aLeft, long aRight);
+String operator+(const String& aLeft, unsigned long aRight);
+
+#endif
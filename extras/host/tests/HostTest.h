@@ -0,0 +1,53 @@
+// Minimal support for the host tests
+// Released under Apache License, version 2.0
+
+#ifndef HostTest_h
+#define HostTest_h
+
+#include <Arduino.h>
+#include "MockStream.h"
+
+// Count how many checks fail, reporting each one, so a test can carry on
+// and main() can return the number of failures
+static int gFailures = 0;
+
+#define CHECK(aCondition) \
+    do { \
+        if (!(aCondition)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #aCondition); \
+            gFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(aExpected, aActual) \
+    do { \
+        long long expected = (aExpected); \
+        long long actual = (aActual); \
+        if (expected != actual) { \
+            printf("%s:%d: expected %s to be %lld, but it was %lld\n", __FILE__, __LINE__, #aActual, expected, actual); \
+            gFailures++; \
+        } \
+    } while (0)
+
+// Print that keeps what's written to it
+class CapturePrint : public Print
+{
+public:
+    CapturePrint() : iLength(0) { iData[0] = '\0'; };
+
+    virtual size_t write(uint8_t c) { return write(&c, 1); };
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize)
+    {
+        size_t toCopy = min(aSize, sizeof(iData) - 1 - iLength);
+
+        memcpy(iData + iLength, aBuffer, toCopy);
+        iLength += toCopy;
+        iData[iLength] = '\0';
+        return toCopy;
+    };
+
+    char iData[4096];
+    size_t iLength;
+};
+
+#endif
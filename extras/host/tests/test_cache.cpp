@@ -0,0 +1,102 @@
+// Keeping responses in HttpMemoryCache
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include "HostTest.h"
+
+// So the tests can set the validators, as HttpStream does
+class TestCache : public HttpMemoryCache
+{
+public:
+    TestCache(uint8_t* aBuffer, size_t aSize) : HttpMemoryCache(aBuffer, aSize) {};
+    using HttpCache::iETag;
+    using HttpCache::iLastModified;
+};
+
+// Store aBody for aPath with the ETag aETag, as HttpStream would
+static bool store(TestCache& aCache, const char* aPath, const char* aETag, const char* aBody, bool aComplete)
+{
+    aCache.find(aPath);
+    strcpy(aCache.iETag, aETag);
+    aCache.iLastModified[0] = '\0';
+    if (!aCache.beginStore(-1))
+    {
+        return false;
+    }
+
+    bool stored = aCache.store((const uint8_t*)aBody, strlen(aBody));
+
+    aCache.endStore(aComplete);
+    return stored;
+}
+
+// Check that the response for aPath is there, with aETag and aBody
+static void checkFound(HttpCache& aCache, const char* aPath, const char* aETag, const char* aBody)
+{
+    char body[64];
+
+    CHECK(aCache.find(aPath));
+    CHECK(!strcmp(aCache.etag(), aETag));
+    CHECK(aCache.beginRead());
+    CHECK_EQUAL(strlen(aBody), aCache.available());
+
+    int count = aCache.read((uint8_t*)body, sizeof(body) - 1);
+
+    CHECK_EQUAL(strlen(aBody), count);
+    body[count > 0 ? count : 0] = '\0';
+    CHECK(!strcmp(body, aBody));
+    CHECK_EQUAL(0, aCache.available());
+}
+
+static void testRefresh()
+{
+    uint8_t buffer[64];
+    TestCache cache(buffer, sizeof(buffer));
+
+    CHECK(store(cache, "/a", "\"1\"", "first", true));
+    checkFound(cache, "/a", "\"1\"", "first");
+
+    // A refresh that's cut off leaves the old one there
+    CHECK(store(cache, "/a", "\"2\"", "second", false));
+    checkFound(cache, "/a", "\"1\"", "first");
+
+    // One that all arrives replaces it
+    CHECK(store(cache, "/a", "\"3\"", "third", true));
+    checkFound(cache, "/a", "\"3\"", "third");
+
+    // As does a response for another path
+    CHECK(store(cache, "/b", "\"4\"", "fourth", true));
+    checkFound(cache, "/b", "\"4\"", "fourth");
+    CHECK(!cache.find("/a"));
+}
+
+static void testNoRoomForBoth()
+{
+    // Enough for the path, the validators and one body
+    uint8_t buffer[40];
+    TestCache cache(buffer, sizeof(buffer));
+    const char kFirst[] = "the first body, 25 bytes";
+    const char kSecond[] = "and the second, 25 bytes";
+
+    CHECK(store(cache, "/a", "\"1\"", kFirst, true));
+    checkFound(cache, "/a", "\"1\"", kFirst);
+
+    // The old one has to go to make room for the new one
+    CHECK(store(cache, "/a", "\"2\"", kSecond, true));
+    checkFound(cache, "/a", "\"2\"", kSecond);
+
+    CHECK(store(cache, "/a", "\"3\"", kFirst, false));
+    CHECK(!cache.find("/a"));
+
+    // One that won't fit even on its own doesn't disturb the old one
+    CHECK(store(cache, "/a", "\"4\"", kSecond, true));
+    CHECK(!store(cache, "/a", "\"5\"", "a body which is much too long to fit", true));
+    checkFound(cache, "/a", "\"4\"", kSecond);
+}
+
+int main()
+{
+    testRefresh();
+    testNoRoomForBoth();
+    return gFailures;
+}
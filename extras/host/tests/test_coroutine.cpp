@@ -0,0 +1,223 @@
+// Running exchanges as coroutines with HttpExecutor, which should only
+// resume them once there's something for them and never wait in between
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include <HttpCoroutine.h>
+#include <limits.h>
+#include "HostTest.h"
+
+// "hello world, hello world, hello world\n" three times, gzipped
+static const uint8_t kGzipped[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xcb, 0x48, 0xcd, 0xc9,
+    0xc9, 0x57, 0x28, 0xcf, 0x2f, 0xca, 0x49, 0xd1, 0x51, 0xc8, 0xc0, 0xc1, 0xe1, 0xca,
+    0xa0, 0xa2, 0x2a, 0x00, 0x96, 0xb8, 0x77, 0x77, 0x72, 0x00, 0x00, 0x00
+};
+static const char kText[] =
+    "hello world, hello world, hello world\n"
+    "hello world, hello world, hello world\n"
+    "hello world, hello world, hello world\n";
+
+// Two masked messages, "hello" and "world!", straight after the upgrade
+static const uint8_t kWebSocket[] = {
+    'H', 'T', 'T', 'P', '/', '1', '.', '1', ' ', '1', '0', '1', ' ', 'O', 'K', '\r', '\n',
+    'U', 'p', 'g', 'r', 'a', 'd', 'e', ':', ' ', 'w', 'e', 'b', 's', 'o', 'c', 'k', 'e', 't', '\r', '\n',
+    '\r', '\n',
+    0x81, 0x85, 0x01, 0x02, 0x03, 0x04, 'h' ^ 1, 'e' ^ 2, 'l' ^ 3, 'l' ^ 4, 'o' ^ 1,
+    0x81, 0x86, 0x05, 0x06, 0x07, 0x08, 'w' ^ 5, 'o' ^ 6, 'r' ^ 7, 'l' ^ 8, 'd' ^ 5, '!' ^ 6
+};
+
+// An empty message, then "hello" given with the 16-bit extended length
+static const uint8_t kWebSocketSplit[] = {
+    'H', 'T', 'T', 'P', '/', '1', '.', '1', ' ', '1', '0', '1', ' ', 'O', 'K', '\r', '\n',
+    '\r', '\n',
+    0x81, 0x80, 0x01, 0x02, 0x03, 0x04,
+    0x81, 0xfe, 0x00, 0x05, 0x01, 0x02, 0x03, 0x04, 'h' ^ 1, 'e' ^ 2, 'l' ^ 3, 'l' ^ 4, 'o' ^ 1
+};
+
+static uint8_t gWindow[32768];
+
+// Keeps track of how long the executor asks to wait
+class RecordingClock : public HttpClock
+{
+public:
+    RecordingClock() : iWaits(0), iShortest(ULONG_MAX), iLatestEnd(0) {};
+
+    virtual void wait(unsigned long aMillis)
+    {
+        iWaits++;
+        iShortest = min(iShortest, aMillis);
+        iLatestEnd = max(iLatestEnd, now() + aMillis);
+        HttpClock::wait(aMillis);
+    };
+
+    unsigned long iWaits;
+    unsigned long iShortest;
+    unsigned long iLatestEnd;
+};
+
+static HttpTask fetch(HttpStream& aHttp, Print& aBody)
+{
+    aHttp.get("/");
+
+    int status = co_await awaitStatus(aHttp);
+
+    co_await awaitHeaders(aHttp);
+
+    uint8_t block[16];
+    int count;
+
+    while ((count = co_await awaitBody(aHttp, block, sizeof(block))) > 0)
+    {
+        aBody.write(block, count);
+    }
+    co_return (count < 0) ? count : status;
+}
+
+// The compressed body arrives a few bytes at a time, and decompressing
+// it mustn't wait for the next few
+static void testGzipped()
+{
+    MockStream mock;
+    HttpStream http(mock);
+    Inflater inflater(gWindow, sizeof(gWindow));
+    CapturePrint body;
+    RecordingClock clock;
+    HttpExecutor executor(&clock);
+    uint8_t response[256];
+    size_t length;
+
+    length = sprintf((char*)response,
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Encoding: gzip\r\n"
+                     "Content-Length: %u\r\n"
+                     "\r\n", (unsigned)sizeof(kGzipped));
+    memcpy(response + length, kGzipped, sizeof(kGzipped));
+    length += sizeof(kGzipped);
+
+    mock.setData(response, length);
+    mock.setFragments(8, 20000);
+    http.setInflater(&inflater);
+
+    size_t most = 0;
+    bool waiting;
+
+    // If it waited for more to arrive it would take in more than one
+    // fragment at a time
+    executor.spawn(fetch(http, body));
+    do
+    {
+        size_t remaining = mock.remaining();
+
+        waiting = executor.runOnce();
+        most = max(most, remaining - mock.remaining());
+    } while (waiting);
+    CHECK(most <= 8);
+    CHECK(!strcmp(body.iData, kText));
+    CHECK_EQUAL(0, mock.remaining());
+    CHECK_EQUAL(0, clock.iWaits);
+}
+
+// run() waits between looks rather than spinning, and for no longer than
+// it takes for the body to time out
+static void testRunWaits()
+{
+    MockStream mock;
+    HttpStream http(mock);
+    CapturePrint body;
+    RecordingClock clock;
+    HttpExecutor executor(&clock);
+    // No Content-Length, so it ends when the server stops sending it, after
+    // the 25ms timeout
+    const char kResponse[] = "HTTP/1.1 200 OK\r\n\r\nhello world\n";
+
+    mock.setData(kResponse);
+    http.setTimeout(25);
+    executor.spawn(fetch(http, body));
+
+    unsigned long start = millis();
+
+    executor.run();
+    CHECK(millis() - start < 25 + HTTP_EXECUTOR_POLL_INTERVAL);
+    CHECK(!strcmp(body.iData, "hello world\n"));
+    CHECK(clock.iWaits > 0);
+    CHECK(clock.iShortest > 0);
+    // The last one is cut short so that it ends as the body times out,
+    // give or take the odd millisecond ticking over
+    CHECK(clock.iLatestEnd - start <= 25 + 2);
+}
+
+static HttpTask receive(WebSocketStream& aWebSocket, Print& aMessages)
+{
+    uint8_t block[64];
+    int count;
+
+    for (int i = 0; i < 2; i++)
+    {
+        co_await awaitMessage(aWebSocket);
+        while ((count = co_await awaitBody(aWebSocket, block, sizeof(block))) > 0)
+        {
+            aMessages.write(block, count);
+        }
+        aMessages.write(',');
+        if (count < 0)
+        {
+            co_return count;
+        }
+    }
+    co_return 0;
+}
+
+// Reading a message only takes that message, even if there's more behind
+// it, and doesn't wait for more to fill the buffer
+static void testWebSocket()
+{
+    MockStream mock;
+    WebSocketStream webSocket(mock);
+    CapturePrint messages;
+    HttpExecutor executor;
+
+    mock.setData(kWebSocket, sizeof(kWebSocket));
+    CHECK_EQUAL(0, webSocket.begin());
+
+    unsigned long start = millis();
+
+    executor.spawn(receive(webSocket, messages));
+    executor.run();
+    CHECK(millis() - start < 100);
+    CHECK(!strcmp(messages.iData, "hello,world!,"));
+}
+
+// Messages whose headers arrive a byte at a time are only parsed once
+// all of the header is here, and an empty one still resumes the task
+static void testWebSocketSplit()
+{
+    MockStream mock;
+    WebSocketStream webSocket(mock);
+    HttpYieldClock clock;
+    CapturePrint messages;
+    HttpExecutor executor;
+
+    mock.setData(kWebSocketSplit, sizeof(kWebSocketSplit));
+    mock.setFragments(1, 1000);
+    webSocket.setClock(&clock);
+    CHECK_EQUAL(0, webSocket.begin());
+
+    unsigned long start = millis();
+
+    executor.spawn(receive(webSocket, messages));
+    while (executor.runOnce() && (millis() - start < 1000))
+    {
+    }
+    CHECK(!strcmp(messages.iData, ",hello,"));
+    CHECK_EQUAL(0, mock.remaining());
+}
+
+int main()
+{
+    testGzipped();
+    testRunWaits();
+    testWebSocket();
+    testWebSocketSplit();
+    return gFailures;
+}
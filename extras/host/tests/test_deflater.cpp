@@ -0,0 +1,160 @@
+// Compressing with Deflater, checked by decompressing with Inflater
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include "HostTest.h"
+
+static uint8_t gDeflateWindow[32768];
+static uint8_t gInflateWindow[32768];
+static uint8_t gData[40000];
+static uint8_t gCompressed[65536];
+static uint8_t gOutput[40001];
+
+// Print which keeps what's written to it in gCompressed
+class CompressedPrint : public Print
+{
+public:
+    CompressedPrint() : iLength(0) {};
+
+    virtual size_t write(uint8_t c) { return write(&c, 1); };
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize)
+    {
+        size_t toCopy = min(aSize, sizeof(gCompressed) - iLength);
+
+        memcpy(gCompressed + iLength, aBuffer, toCopy);
+        iLength += toCopy;
+        return toCopy;
+    };
+
+    size_t iLength;
+};
+
+// Hands all of the compressed data to the Inflater at once
+typedef struct {
+    const uint8_t* iData;
+    size_t iLength;
+} tSource;
+
+static int fill(uint8_t* aBuffer, size_t aSize, void* aContext)
+{
+    tSource* source = (tSource*)aContext;
+    size_t count = min(aSize, source->iLength);
+
+    memcpy(aBuffer, source->iData, count);
+    source->iData += count;
+    source->iLength -= count;
+    return count;
+}
+
+// Repetitive text, which compresses well
+static size_t makeText(size_t aLength)
+{
+    size_t length = 0;
+
+    for (int i = 0; length < aLength; i++)
+    {
+        char line[64];
+        size_t lineLength = sprintf(line, "line %d: the quick brown fox jumps over the lazy dog\n", i % 50);
+
+        lineLength = min(lineLength, aLength - length);
+        memcpy(gData + length, line, lineLength);
+        length += lineLength;
+    }
+    return length;
+}
+
+// Bytes which don't repeat, so come out bigger than they went in
+static size_t makeNoise(size_t aLength)
+{
+    uint32_t seed = 12345;
+
+    for (size_t i = 0; i < aLength; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        gData[i] = seed >> 16;
+    }
+    return aLength;
+}
+
+// Compress aLength bytes of gData, aWriteSize bytes at a time, with a
+// window of aWindowSize, and check it decompresses to the same again
+static void testRoundTrip(size_t aLength, size_t aWindowSize, size_t aWriteSize)
+{
+    Deflater deflater(gDeflateWindow, aWindowSize);
+    CompressedPrint compressed;
+    size_t expectedLength = deflater.compressedLength(gData, aLength);
+
+    deflater.begin(compressed);
+    for (size_t written = 0; written < aLength; written += aWriteSize)
+    {
+        size_t count = min(aWriteSize, aLength - written);
+
+        CHECK_EQUAL(count, deflater.write(gData + written, count));
+    }
+    CHECK(deflater.end());
+
+    // compressedLength() must give exactly what's written, as it's sent as
+    // the Content-Length
+    CHECK_EQUAL(expectedLength, compressed.iLength);
+
+    // A zlib header, then the first block compressed with the fixed codes
+    CHECK_EQUAL(8, gCompressed[0] & 0x0f);
+    CHECK_EQUAL(0, ((gCompressed[0] << 8) | gCompressed[1]) % 31);
+    CHECK_EQUAL(1, (gCompressed[2] >> 1) & 3);
+
+    Inflater inflater(gInflateWindow, sizeof(gInflateWindow));
+    tSource source = { gCompressed, compressed.iLength };
+    size_t count = 0;
+    int ret;
+
+    inflater.begin(Inflater::eFormatDeflate, fill, &source);
+    while ((ret = inflater.read(gOutput + count, sizeof(gOutput) - count)) > 0)
+    {
+        count += ret;
+    }
+    CHECK_EQUAL(0, ret);
+    CHECK(inflater.finished());
+    CHECK_EQUAL(aLength, count);
+    CHECK(!memcmp(gOutput, gData, aLength));
+}
+
+// HttpStream sends the compressed body with a Content-Length that matches
+static void testRequest(size_t aLength)
+{
+    MockStream mock;
+    HttpStream http(mock);
+    Deflater deflater(gDeflateWindow, sizeof(gDeflateWindow));
+
+    mock.setOutput(gCompressed, sizeof(gCompressed) - 1);
+    http.setDeflater(&deflater);
+    CHECK_EQUAL(HTTP_SUCCESS, http.post("/", "application/octet-stream", aLength, gData));
+    gCompressed[min(mock.iWritten, sizeof(gCompressed) - 1)] = '\0';
+
+    const char* header = strstr((const char*)gCompressed, "Content-Length: ");
+    const char* body = strstr((const char*)gCompressed, "\r\n\r\n");
+
+    CHECK(header && body);
+    if (header && body)
+    {
+        body += 4;
+        CHECK_EQUAL(mock.iWritten - (body - (const char*)gCompressed), strtoul(header + 16, NULL, 10));
+    }
+}
+
+int main()
+{
+    size_t length = makeText(sizeof(gData));
+
+    testRoundTrip(0, sizeof(gDeflateWindow), 1);
+    testRoundTrip(600, sizeof(gDeflateWindow), 1);
+    testRoundTrip(length, sizeof(gDeflateWindow), 4096);
+    // Sliding the window along
+    testRoundTrip(length, 1024, 100);
+    testRequest(length);
+
+    length = makeNoise(sizeof(gData));
+    testRoundTrip(length, sizeof(gDeflateWindow), 333);
+    // Bigger than an int on AVR once it's compressed
+    testRequest(length);
+    return gFailures;
+}
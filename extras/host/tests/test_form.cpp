@@ -0,0 +1,50 @@
+// Sending application/x-www-form-urlencoded bodies
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include <limits.h>
+#include "HostTest.h"
+
+static void testSend()
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpForm form;
+    uint8_t output[512];
+    char text[128];
+
+    mock.setData("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+    mock.setOutput(output, sizeof(output) - 1);
+    CHECK(form.add("name", "a b&c"));
+    CHECK(form.add("min", LONG_MIN));
+    CHECK(form.add("max", LONG_MAX));
+
+    CHECK_EQUAL(HTTP_SUCCESS, form.send(http, "/form"));
+    output[min(mock.iWritten, sizeof(output) - 1)] = '\0';
+
+    snprintf(text, sizeof(text), "name=a%%20b%%26c&min=%ld&max=%ld", LONG_MIN, LONG_MAX);
+    CHECK_EQUAL(strlen(text), form.contentLength());
+    snprintf(text, sizeof(text), "Content-Length: %u\r\n", (unsigned)form.contentLength());
+    CHECK(strstr((const char*)output, text));
+    snprintf(text, sizeof(text), "\r\n\r\nname=a%%20b%%26c&min=%ld&max=%ld", LONG_MIN, LONG_MAX);
+    CHECK(strstr((const char*)output, text));
+}
+
+// Plain ints, including 0, which could otherwise be taken for a NULL string
+static void testInt()
+{
+    HttpForm form;
+    CapturePrint output;
+
+    CHECK(form.add("zero", 0));
+    CHECK(form.add("n", -12));
+    CHECK_EQUAL(HTTP_SUCCESS, form.writeTo(output));
+    CHECK(!strcmp(output.iData, "zero=0&n=-12"));
+}
+
+int main()
+{
+    testSend();
+    testInt();
+    return gFailures;
+}
@@ -0,0 +1,202 @@
+// Decompressing a piece at a time, whether the data arrives all at once,
+// a byte at a time, or with gaps when there's none yet
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include "HostTest.h"
+
+// Generated with Python's zlib from the same text as makeText() gives
+// 2223 bytes of the text, Inflater::eFormatGzip
+static const uint8_t kGzip[] = {
+    0x1f, 0x8b, 0x08, 0x1e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x05, 0x00, 0x65, 0x78, 0x74, 0x72,
+    0x61, 0x6e, 0x61, 0x6d, 0x65, 0x2e, 0x74, 0x78, 0x74, 0x00, 0x61, 0x20, 0x63, 0x6f, 0x6d, 0x6d,
+    0x65, 0x6e, 0x74, 0x00, 0x12, 0x34, 0x95, 0xd5, 0x59, 0x52, 0xc3, 0x30, 0x10, 0x45, 0xd1, 0xff,
+    0xac, 0x42, 0x4b, 0x88, 0xba, 0x2d, 0x59, 0x62, 0x37, 0x0c, 0x06, 0x02, 0x26, 0x86, 0x84, 0x30,
+    0xad, 0x9e, 0x02, 0xbd, 0x5e, 0xc0, 0xfd, 0x76, 0xdd, 0xd2, 0x74, 0x24, 0xaf, 0x87, 0xe3, 0x92,
+    0xf6, 0x57, 0xe9, 0xfd, 0x71, 0x49, 0x6f, 0x97, 0xc3, 0xed, 0x73, 0xba, 0x39, 0x6d, 0x9f, 0xc7,
+    0x74, 0xbf, 0x7d, 0xa5, 0xa7, 0xcb, 0xcb, 0xeb, 0x39, 0x6d, 0x1f, 0xcb, 0xe9, 0xff, 0xf3, 0x7a,
+    0xfd, 0xf3, 0x9d, 0xee, 0xb6, 0x87, 0xb4, 0xdf, 0xad, 0x7f, 0x55, 0x66, 0x55, 0x1e, 0x95, 0xb1,
+    0x6a, 0x1a, 0x95, 0xb3, 0xaa, 0x8f, 0x6a, 0x82, 0x33, 0xac, 0x23, 0x2b, 0x2c, 0xb3, 0x32, 0xb2,
+    0xca, 0x32, 0xd7, 0x68, 0x33, 0xdc, 0x10, 0xad, 0xad, 0xb1, 0xac, 0x6a, 0x23, 0x3b, 0xcb, 0x9a,
+    0x4e, 0x2d, 0x43, 0x22, 0xae, 0x0c, 0x1a, 0x31, 0xcd, 0x32, 0x53, 0x25, 0xb3, 0x3a, 0xe8, 0x64,
+    0x36, 0x75, 0x50, 0x4a, 0x64, 0x50, 0x8a, 0xc7, 0x6e, 0x42, 0x2a, 0x35, 0xc6, 0x83, 0x56, 0xba,
+    0x64, 0x66, 0x88, 0xc5, 0xe3, 0xf8, 0xa0, 0x96, 0x59, 0x2f, 0x83, 0x41, 0x2d, 0x59, 0xeb, 0x33,
+    0xc8, 0xa5, 0x68, 0x9e, 0x06, 0xb9, 0x74, 0x5d, 0x3d, 0x83, 0x5c, 0x26, 0xf1, 0x34, 0xc8, 0xa5,
+    0xc7, 0xdb, 0x07, 0xbd, 0x4c, 0xb1, 0x3e, 0xe8, 0xa5, 0xc7, 0x3c, 0xa1, 0x97, 0x12, 0xe7, 0x07,
+    0xbd, 0x34, 0x65, 0x90, 0x4b, 0x15, 0x4f, 0x87, 0x5c, 0x4c, 0xb7, 0xdd, 0x21, 0x97, 0xa6, 0x79,
+    0x3a, 0xe4, 0x52, 0xe2, 0x27, 0x04, 0xb9, 0x98, 0x58, 0x3b, 0xe4, 0xd2, 0xf4, 0xc4, 0x3b, 0xe4,
+    0x52, 0xc5, 0xcc, 0xe9, 0x9f, 0x28, 0xce, 0x01, 0x72, 0xc9, 0x31, 0x1e, 0xe5, 0xa2, 0xeb, 0xe7,
+    0xd4, 0x4b, 0xdd, 0xfd, 0x02, 0x14, 0x00, 0x12, 0x4a, 0xaf, 0x08, 0x00, 0x00,
+};
+// 2223 bytes of the text, Inflater::eFormatDeflate
+static const uint8_t kZlib[] = {
+    0x78, 0xda, 0x95, 0xd5, 0x59, 0x52, 0xc3, 0x30, 0x10, 0x45, 0xd1, 0xff, 0xac, 0x42, 0x4b, 0x88,
+    0xba, 0x2d, 0x59, 0x62, 0x37, 0x0c, 0x06, 0x02, 0x26, 0x86, 0x84, 0x30, 0xad, 0x9e, 0x02, 0xbd,
+    0x5e, 0xc0, 0xfd, 0x76, 0xdd, 0xd2, 0x74, 0x24, 0xaf, 0x87, 0xe3, 0x92, 0xf6, 0x57, 0xe9, 0xfd,
+    0x71, 0x49, 0x6f, 0x97, 0xc3, 0xed, 0x73, 0xba, 0x39, 0x6d, 0x9f, 0xc7, 0x74, 0xbf, 0x7d, 0xa5,
+    0xa7, 0xcb, 0xcb, 0xeb, 0x39, 0x6d, 0x1f, 0xcb, 0xe9, 0xff, 0xf3, 0x7a, 0xfd, 0xf3, 0x9d, 0xee,
+    0xb6, 0x87, 0xb4, 0xdf, 0xad, 0x7f, 0x55, 0x66, 0x55, 0x1e, 0x95, 0xb1, 0x6a, 0x1a, 0x95, 0xb3,
+    0xaa, 0x8f, 0x6a, 0x82, 0x33, 0xac, 0x23, 0x2b, 0x2c, 0xb3, 0x32, 0xb2, 0xca, 0x32, 0xd7, 0x68,
+    0x33, 0xdc, 0x10, 0xad, 0xad, 0xb1, 0xac, 0x6a, 0x23, 0x3b, 0xcb, 0x9a, 0x4e, 0x2d, 0x43, 0x22,
+    0xae, 0x0c, 0x1a, 0x31, 0xcd, 0x32, 0x53, 0x25, 0xb3, 0x3a, 0xe8, 0x64, 0x36, 0x75, 0x50, 0x4a,
+    0x64, 0x50, 0x8a, 0xc7, 0x6e, 0x42, 0x2a, 0x35, 0xc6, 0x83, 0x56, 0xba, 0x64, 0x66, 0x88, 0xc5,
+    0xe3, 0xf8, 0xa0, 0x96, 0x59, 0x2f, 0x83, 0x41, 0x2d, 0x59, 0xeb, 0x33, 0xc8, 0xa5, 0x68, 0x9e,
+    0x06, 0xb9, 0x74, 0x5d, 0x3d, 0x83, 0x5c, 0x26, 0xf1, 0x34, 0xc8, 0xa5, 0xc7, 0xdb, 0x07, 0xbd,
+    0x4c, 0xb1, 0x3e, 0xe8, 0xa5, 0xc7, 0x3c, 0xa1, 0x97, 0x12, 0xe7, 0x07, 0xbd, 0x34, 0x65, 0x90,
+    0x4b, 0x15, 0x4f, 0x87, 0x5c, 0x4c, 0xb7, 0xdd, 0x21, 0x97, 0xa6, 0x79, 0x3a, 0xe4, 0x52, 0xe2,
+    0x27, 0x04, 0xb9, 0x98, 0x58, 0x3b, 0xe4, 0xd2, 0xf4, 0xc4, 0x3b, 0xe4, 0x52, 0xc5, 0xcc, 0xe9,
+    0x9f, 0x28, 0xce, 0x01, 0x72, 0xc9, 0x31, 0x1e, 0xe5, 0xa2, 0xeb, 0xe7, 0xd4, 0x4b, 0xdd, 0xfd,
+    0x02, 0xf7, 0x64, 0xf7, 0xec,
+};
+// 600 bytes of the text, Inflater::eFormatDeflate
+static const uint8_t kFixed[] = {
+    0xcb, 0xc9, 0xcc, 0x4b, 0x55, 0x30, 0xb0, 0x52, 0x28, 0xc9, 0x48, 0x55, 0x28, 0x2c, 0xcd, 0x4c,
+    0xce, 0x56, 0x48, 0x2a, 0xca, 0x2f, 0xcf, 0x53, 0x48, 0xcb, 0xaf, 0x50, 0xc8, 0x2a, 0xcd, 0x2d,
+    0x28, 0x56, 0xc8, 0x2f, 0x4b, 0x2d, 0x02, 0x4b, 0xe7, 0x24, 0x56, 0x55, 0x2a, 0xa4, 0xe4, 0xa7,
+    0x2b, 0x18, 0x70, 0xe5, 0x80, 0x74, 0x19, 0x92, 0xa6, 0xcb, 0x10, 0xa2, 0xcb, 0x88, 0x34, 0x5d,
+    0x26, 0x10, 0x5d, 0xc6, 0xa4, 0xe9, 0xb2, 0x84, 0xe8, 0x32, 0x21, 0xd1, 0x85, 0x66, 0x10, 0x6d,
+    0xa6, 0xa4, 0x69, 0x33, 0x32, 0x85, 0x68, 0x33, 0x23, 0x4d, 0x9b, 0x31, 0xd4, 0x36, 0x73, 0x12,
+    0x03, 0x04, 0xea, 0x37, 0x0b, 0xd2, 0xb4, 0x99, 0x41, 0x03, 0xd2, 0x92, 0x34, 0x6d, 0x16, 0xd0,
+    0x58, 0x33, 0x24, 0x31, 0x89, 0x18, 0x03, 0x00,
+};
+// 200 bytes of the text, Inflater::eFormatDeflate
+static const uint8_t kStored[] = {
+    0x01, 0xc8, 0x00, 0x37, 0xff, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x30, 0x3a, 0x20, 0x74, 0x68, 0x65,
+    0x20, 0x71, 0x75, 0x69, 0x63, 0x6b, 0x20, 0x62, 0x72, 0x6f, 0x77, 0x6e, 0x20, 0x66, 0x6f, 0x78,
+    0x20, 0x6a, 0x75, 0x6d, 0x70, 0x73, 0x20, 0x6f, 0x76, 0x65, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20,
+    0x6c, 0x61, 0x7a, 0x79, 0x20, 0x64, 0x6f, 0x67, 0x20, 0x30, 0x0a, 0x6c, 0x69, 0x6e, 0x65, 0x20,
+    0x31, 0x3a, 0x20, 0x74, 0x68, 0x65, 0x20, 0x71, 0x75, 0x69, 0x63, 0x6b, 0x20, 0x62, 0x72, 0x6f,
+    0x77, 0x6e, 0x20, 0x66, 0x6f, 0x78, 0x20, 0x6a, 0x75, 0x6d, 0x70, 0x73, 0x20, 0x6f, 0x76, 0x65,
+    0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6c, 0x61, 0x7a, 0x79, 0x20, 0x64, 0x6f, 0x67, 0x20, 0x31,
+    0x0a, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x32, 0x3a, 0x20, 0x74, 0x68, 0x65, 0x20, 0x71, 0x75, 0x69,
+    0x63, 0x6b, 0x20, 0x62, 0x72, 0x6f, 0x77, 0x6e, 0x20, 0x66, 0x6f, 0x78, 0x20, 0x6a, 0x75, 0x6d,
+    0x70, 0x73, 0x20, 0x6f, 0x76, 0x65, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6c, 0x61, 0x7a, 0x79,
+    0x20, 0x64, 0x6f, 0x67, 0x20, 0x34, 0x0a, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x33, 0x3a, 0x20, 0x74,
+    0x68, 0x65, 0x20, 0x71, 0x75, 0x69, 0x63, 0x6b, 0x20, 0x62, 0x72, 0x6f, 0x77, 0x6e, 0x20, 0x66,
+    0x6f, 0x78, 0x20, 0x6a, 0x75, 0x6d, 0x70, 0x73, 0x20, 0x6f, 0x76, 0x65, 0x72,
+};
+
+// A dynamic block whose distance code has a single symbol, and the same
+// block using that code's unused bit pattern, which must fail
+static const uint8_t kSingleCode[] = { 13, 192, 1, 9, 0, 0, 0, 128, 160, 173, 253, 63, 145, 6, 3 };
+static const uint8_t kSingleCodeInvalid[] = { 13, 192, 1, 9, 0, 0, 0, 128, 160, 173, 253, 63, 145, 134, 3 };
+
+static uint8_t gWindow[32768];
+static char gText[4096];
+
+static size_t makeText()
+{
+    size_t length = 0;
+
+    for (int i = 0; i < 40; i++)
+    {
+        length += sprintf(gText + length, "line %d: the quick brown fox jumps over the lazy dog %d\n", i, (i * i) % 97);
+    }
+    return length;
+}
+
+// Hands out the compressed data aFillSize bytes at a time, with
+// Inflater::kNotYet in between if aGaps is set
+class Source
+{
+public:
+    Source(const uint8_t* aData, size_t aLength, size_t aFillSize, bool aGaps)
+     : iData(aData), iLength(aLength), iFillSize(aFillSize), iGaps(aGaps), iGap(false) {};
+
+    static int fill(uint8_t* aBuffer, size_t aSize, void* aContext)
+    {
+        Source* self = (Source*)aContext;
+
+        self->iGap = !self->iGap;
+        if (self->iGaps && self->iGap)
+        {
+            return Inflater::kNotYet;
+        }
+
+        size_t count = min(min(aSize, self->iFillSize), self->iLength);
+
+        memcpy(aBuffer, self->iData, count);
+        self->iData += count;
+        self->iLength -= count;
+        return count;
+    };
+
+    const uint8_t* iData;
+    size_t iLength;
+    size_t iFillSize;
+    bool iGaps;
+    bool iGap;
+};
+
+// Decompress aData, aReadSize bytes at a time
+// @return How many bytes it gave, or -1 if it failed
+static int inflate(const uint8_t* aData, size_t aLength, Inflater::tFormat aFormat,
+                   size_t aFillSize, bool aGaps, size_t aReadSize, uint8_t* aOutput, size_t aOutputSize)
+{
+    Inflater inflater(gWindow, sizeof(gWindow));
+    Source source(aData, aLength, aFillSize, aGaps);
+    size_t count = 0;
+    int ret;
+
+    inflater.begin(aFormat, Source::fill, &source);
+    do
+    {
+        ret = inflater.read(aOutput + count, min(aReadSize, aOutputSize - count));
+        if (ret > 0)
+        {
+            count += ret;
+        }
+        else if (ret == Inflater::kNotYet)
+        {
+            CHECK(aGaps);
+        }
+    } while ((ret != 0) && (ret != -1) && (count < aOutputSize));
+
+    CHECK(inflater.finished() || inflater.failed());
+    return inflater.failed() ? -1 : (int)count;
+}
+
+static void testInflate(const uint8_t* aData, size_t aLength, Inflater::tFormat aFormat, size_t aTextLength)
+{
+    const size_t kFillSizes[] = { 1, 3, 16 };
+    const size_t kReadSizes[] = { 1, 7, 4096 };
+    static uint8_t output[4096];
+
+    for (size_t fill = 0; fill < sizeof(kFillSizes) / sizeof(kFillSizes[0]); fill++)
+    {
+        for (size_t read = 0; read < sizeof(kReadSizes) / sizeof(kReadSizes[0]); read++)
+        {
+            for (int gaps = 0; gaps < 2; gaps++)
+            {
+                int count = inflate(aData, aLength, aFormat, kFillSizes[fill], gaps, kReadSizes[read],
+                                    output, sizeof(output));
+
+                CHECK_EQUAL(aTextLength, count);
+                CHECK(!memcmp(output, gText, aTextLength));
+            }
+        }
+    }
+}
+
+static void testSingleCode()
+{
+    uint8_t output[64];
+
+    for (int gaps = 0; gaps < 2; gaps++)
+    {
+        CHECK_EQUAL(7, inflate(kSingleCode, sizeof(kSingleCode), Inflater::eFormatDeflate, 1, gaps, 64, output, sizeof(output)));
+        CHECK_EQUAL(-1, inflate(kSingleCodeInvalid, sizeof(kSingleCodeInvalid), Inflater::eFormatDeflate, 1, gaps, 64, output, sizeof(output)));
+    }
+}
+
+int main()
+{
+    size_t length = makeText();
+
+    testInflate(kGzip, sizeof(kGzip), Inflater::eFormatGzip, length);
+    testInflate(kZlib, sizeof(kZlib), Inflater::eFormatDeflate, length);
+    testInflate(kFixed, sizeof(kFixed), Inflater::eFormatDeflate, 600);
+    testInflate(kStored, sizeof(kStored), Inflater::eFormatDeflate, 200);
+    testSingleCode();
+    return gFailures;
+}
@@ -0,0 +1,76 @@
+// Finding values in a JSON body by their path
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include "HostTest.h"
+
+static const char kDevices[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 51\r\n"
+    "\r\n"
+    "{\"devices\": [{\"name\": \"a\"}, {\"name\": \"b\"}], \"n\": 2}";
+
+// Keys with brackets in them, which aren't array indices
+static const char kBrackets[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 26\r\n"
+    "\r\n"
+    "{\"a[\": 1, \"b[0]\": [2, 3]}\n";
+
+static void begin(MockStream& aMock, HttpStream& aHttp, HttpYieldClock& aClock, const char* aResponse)
+{
+    aMock.setData(aResponse);
+    aMock.setFragments(5);
+    aHttp.setClock(&aClock);
+    aHttp.setTimeout(10);
+
+    CHECK_EQUAL(HTTP_SUCCESS, aHttp.get("/"));
+    CHECK_EQUAL(200, aHttp.responseStatusCode());
+}
+
+static void testFind()
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpYieldClock clock;
+    char value[16];
+
+    begin(mock, http, clock, kDevices);
+    HttpJsonReader json(http, value, sizeof(value));
+
+    CHECK_EQUAL(HttpJsonReader::eTokenString, json.find("devices[*].name"));
+    CHECK(!strcmp(json.path(), "devices[0].name"));
+    CHECK(!strcmp(json.value(), "a"));
+    CHECK_EQUAL(HttpJsonReader::eTokenString, json.find("devices[*].name"));
+    CHECK(!strcmp(json.path(), "devices[1].name"));
+    CHECK(!strcmp(json.value(), "b"));
+    CHECK_EQUAL(HttpJsonReader::eTokenNumber, json.find("n"));
+    CHECK_EQUAL(2, json.valueAsLong());
+    CHECK_EQUAL(HttpJsonReader::eTokenEnd, json.find("devices[*].name"));
+}
+
+static void testBracketsInKeys(const char* aPattern, HttpJsonReader::tToken aToken, const char* aPath)
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpYieldClock clock;
+    char value[16];
+
+    begin(mock, http, clock, kBrackets);
+    HttpJsonReader json(http, value, sizeof(value));
+
+    CHECK_EQUAL(aToken, json.find(aPattern));
+    CHECK(!strcmp(json.path(), aPath));
+}
+
+int main()
+{
+    testFind();
+    // "[*]" only matches an index, not a '[' in a key
+    testBracketsInKeys("a[*]", HttpJsonReader::eTokenEnd, "");
+    testBracketsInKeys("b[*]", HttpJsonReader::eTokenEnd, "");
+    testBracketsInKeys("b[0][*]", HttpJsonReader::eTokenNumber, "b[0][0]");
+    return gFailures;
+}
@@ -0,0 +1,40 @@
+// Sending multipart/form-data bodies
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include "HostTest.h"
+
+static const char kContents[] = "contents of the file";
+
+// Send a body with one part read from a stream, named so its headers are
+// aHeadersLength bytes long
+static void testStream(size_t aHeadersLength)
+{
+    HttpMultipart multipart;
+    MockStream source;
+    CapturePrint output;
+    char name[HTTP_MULTIPART_BLOCK_SIZE * 2];
+    // "--<boundary>\r\nContent-Disposition: form-data; name=\"\"\r\n\r\n"
+    size_t overhead = 2 + strlen(multipart.boundary()) + 45;
+
+    memset(name, 'n', aHeadersLength - overhead);
+    name[aHeadersLength - overhead] = '\0';
+    source.setData(kContents);
+    source.setFragments(7);
+    CHECK(multipart.addStream(name, NULL, NULL, source, strlen(kContents)));
+
+    CHECK_EQUAL(HTTP_SUCCESS, multipart.writeTo(output));
+    CHECK_EQUAL(multipart.contentLength(), output.iLength);
+    CHECK(!strncmp(output.iData + aHeadersLength, kContents, strlen(kContents)));
+    CHECK_EQUAL(0, source.remaining());
+}
+
+int main()
+{
+    // Including when the headers fill the block exactly
+    for (size_t length = HTTP_MULTIPART_BLOCK_SIZE - 2; length <= HTTP_MULTIPART_BLOCK_SIZE + 2; length++)
+    {
+        testStream(length);
+    }
+    return gFailures;
+}
@@ -0,0 +1,206 @@
+// Running requests with HttpStreamPool, without waiting for responses
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include "HostTest.h"
+
+// Two responses on the same connection, then one which closes it
+static const char kResponses[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 12\r\n"
+    "\r\n"
+    "hello world\n"
+    "HTTP/1.1 201 Created\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "6\r\nhello \r\n"
+    "6\r\nworld\n\r\n"
+    "0\r\n"
+    "\r\n"
+    "HTTP/1.1 202 Accepted\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 2\r\n"
+    "\r\n"
+    "ok";
+
+// "hello world, hello world, hello world\n" three times, gzipped
+static const uint8_t kGzipped[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xcb, 0x48, 0xcd, 0xc9,
+    0xc9, 0x57, 0x28, 0xcf, 0x2f, 0xca, 0x49, 0xd1, 0x51, 0xc8, 0xc0, 0xc1, 0xe1, 0xca,
+    0xa0, 0xa2, 0x2a, 0x00, 0x96, 0xb8, 0x77, 0x77, 0x72, 0x00, 0x00, 0x00
+};
+
+static uint8_t gWindow[32768];
+
+typedef struct {
+    int iCalls;
+    int iStatus;
+    bool iReusable;
+} tResult;
+
+static void callback(HttpStream&, int aStatus, bool aReusable, void* aContext)
+{
+    tResult* result = (tResult*)aContext;
+
+    result->iCalls++;
+    result->iStatus = aStatus;
+    result->iReusable = aReusable;
+}
+
+static void testPool(size_t aFragmentSize)
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpStreamPool pool;
+    CapturePrint body;
+    uint8_t requests[1024];
+    tResult results[3] = {};
+
+    mock.setData(kResponses);
+    mock.setFragments(aFragmentSize, 500);
+    mock.setOutput(requests, sizeof(requests) - 1);
+    CHECK(pool.add(http));
+
+    // The first body is left for the callback, which doesn't read it
+    CHECK(pool.get("/first", callback, &results[0]));
+    CHECK(pool.get("/second", callback, &results[1], &body));
+    CHECK(pool.get("/third", callback, &results[2], &body));
+
+    // It only reads what's available, so every call comes straight back
+    // with a bit more done.  If it waited for more to arrive it would take
+    // in more than one fragment at a time
+    unsigned long start = millis();
+    size_t most = 0;
+    int pending;
+
+    do
+    {
+        size_t remaining = mock.remaining();
+
+        pending = pool.poll();
+        most = max(most, remaining - mock.remaining());
+    } while (pending && ((millis() - start) < 5000));
+    CHECK(!aFragmentSize || (most <= aFragmentSize));
+    CHECK_EQUAL(0, pool.pending());
+    CHECK_EQUAL(0, mock.remaining());
+
+    CHECK_EQUAL(1, results[0].iCalls);
+    CHECK_EQUAL(200, results[0].iStatus);
+    CHECK(results[0].iReusable);
+    CHECK_EQUAL(1, results[1].iCalls);
+    CHECK_EQUAL(201, results[1].iStatus);
+    CHECK(results[1].iReusable);
+    CHECK_EQUAL(1, results[2].iCalls);
+    CHECK_EQUAL(202, results[2].iStatus);
+    CHECK(!results[2].iReusable);
+    CHECK(!strcmp(body.iData, "hello world\nok"));
+}
+
+// Decompressing only uses what has arrived, so it doesn't hold up poll()
+static void testCompressed()
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpStreamPool pool;
+    CapturePrint body;
+    Inflater inflater(gWindow, sizeof(gWindow));
+    uint8_t response[256];
+    uint8_t requests[256];
+    tResult result = {};
+    size_t length;
+
+    length = sprintf((char*)response,
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Encoding: gzip\r\n"
+                     "Content-Length: %u\r\n"
+                     "\r\n", (unsigned)sizeof(kGzipped));
+    memcpy(response + length, kGzipped, sizeof(kGzipped));
+    length += sizeof(kGzipped);
+
+    mock.setData(response, length);
+    mock.setFragments(8, 10000);
+    mock.setOutput(requests, sizeof(requests) - 1);
+    http.setInflater(&inflater);
+    CHECK(pool.add(http));
+    CHECK(pool.get("/", callback, &result, &body));
+
+    // Each fragment is 10ms behind the last, so taking in more than one
+    // in a poll means it waited for the next
+    unsigned long start = millis();
+    size_t most = 0;
+
+    while (pool.pending() && ((millis() - start) < 5000))
+    {
+        size_t remaining = mock.remaining();
+
+        pool.poll();
+        most = max(most, remaining - mock.remaining());
+    }
+    CHECK(most <= 8);
+    CHECK_EQUAL(1, result.iCalls);
+    CHECK_EQUAL(200, result.iStatus);
+    CHECK(!strcmp(body.iData,
+                  "hello world, hello world, hello world\n"
+                  "hello world, hello world, hello world\n"
+                  "hello world, hello world, hello world\n"));
+
+    requests[min(mock.iWritten, sizeof(requests) - 1)] = '\0';
+    CHECK(strstr((const char*)requests, HTTP_HEADER_ACCEPT_ENCODING));
+}
+
+// Once the server closes the connection the next request waits until
+// reconnected() says it has been opened again
+static void testReconnect()
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpStreamPool pool;
+    CapturePrint body;
+    uint8_t requests[256];
+    tResult results[2] = {};
+
+    mock.setData("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nok");
+    mock.setOutput(requests, sizeof(requests) - 1);
+    CHECK(pool.add(http));
+    CHECK(pool.get("/first", callback, &results[0], &body));
+    CHECK(pool.get("/second", callback, &results[1], &body));
+
+    for (int i = 0; i < 10; i++)
+    {
+        pool.poll();
+    }
+    CHECK_EQUAL(1, results[0].iCalls);
+    CHECK(!results[0].iReusable);
+    CHECK_EQUAL(0, results[1].iCalls);
+    CHECK_EQUAL(1, pool.pending());
+    requests[min(mock.iWritten, sizeof(requests) - 1)] = '\0';
+    CHECK(strstr((const char*)requests, "/first"));
+    CHECK(!strstr((const char*)requests, "/second"));
+
+    MockStream otherMock;
+    HttpStream other(otherMock);
+
+    CHECK(!pool.reconnected(other));
+
+    mock.setData("HTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nok");
+    CHECK(pool.reconnected(http));
+    for (int i = 0; (i < 10) && pool.pending(); i++)
+    {
+        pool.poll();
+    }
+    CHECK_EQUAL(0, pool.pending());
+    CHECK_EQUAL(1, results[1].iCalls);
+    CHECK_EQUAL(201, results[1].iStatus);
+    CHECK(!strcmp(body.iData, "okok"));
+}
+
+int main()
+{
+    for (size_t fragmentSize = 0; fragmentSize <= 7; fragmentSize++)
+    {
+        testPool(fragmentSize);
+    }
+    testCompressed();
+    testReconnect();
+    return gFailures;
+}
@@ -0,0 +1,99 @@
+// Reading responses, whole and a few bytes at a time
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include "HostTest.h"
+
+static const char kContentLength[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 12\r\n"
+    "\r\n"
+    "hello world\n";
+
+static const char kChunked[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "6;name=value\r\nhello \r\n"
+    "6\r\nworld\n\r\n"
+    "0\r\n"
+    "\r\n";
+
+// The tokens follow a false start on their first character
+static const char kRepeatedStart[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: cchunked\r\n"
+    "Connection: keep-alive, cclose\r\n"
+    "\r\n"
+    "c\r\nhello world\n\r\n"
+    "0\r\n"
+    "\r\n";
+
+static void testResponse(const char* aResponse, size_t aFragmentSize)
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpYieldClock clock;
+    CapturePrint body;
+
+    mock.setData(aResponse);
+    mock.setFragments(aFragmentSize);
+    http.setClock(&clock);
+    http.setTimeout(10);
+
+    CHECK_EQUAL(HTTP_SUCCESS, http.get("/"));
+    CHECK_EQUAL(200, http.responseStatusCode());
+    CHECK_EQUAL(12, http.responseBody(body));
+    CHECK(!strcmp(body.iData, "hello world\n"));
+    CHECK(http.endOfBodyReached());
+    CHECK(http.canReuseConnection());
+}
+
+static void testRepeatedStart()
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpYieldClock clock;
+    CapturePrint body;
+
+    mock.setData(kRepeatedStart);
+    http.setClock(&clock);
+    http.setTimeout(10);
+
+    CHECK_EQUAL(HTTP_SUCCESS, http.get("/"));
+    CHECK_EQUAL(200, http.responseStatusCode());
+    CHECK_EQUAL(12, http.responseBody(body));
+    CHECK(http.isResponseChunked());
+    CHECK(!http.canReuseConnection());
+}
+
+// With the default clock, a response that turns up soon after the request
+// is noticed soon after, not at the end of a long pause
+static void testPromptResponse()
+{
+    MockStream mock;
+    HttpStream http(mock);
+
+    mock.setData(kContentLength);
+    mock.setFragments(0, 20000);
+
+    unsigned long start = millis();
+
+    CHECK_EQUAL(HTTP_SUCCESS, http.get("/"));
+    CHECK_EQUAL(200, http.responseStatusCode());
+    CHECK_EQUAL(HTTP_SUCCESS, http.skipResponseHeaders());
+    CHECK(millis() - start < 500);
+}
+
+int main()
+{
+    for (size_t fragmentSize = 0; fragmentSize <= 7; fragmentSize++)
+    {
+        testResponse(kContentLength, fragmentSize);
+        testResponse(kChunked, fragmentSize);
+    }
+    testRepeatedStart();
+    testPromptResponse();
+    return gFailures;
+}
@@ -0,0 +1,123 @@
+// Bodies which stop arriving before their end must be reported as errors
+// Released under Apache License, version 2.0
+
+#include <ArduinoHttpStream.h>
+#include "HostTest.h"
+
+// Cut off part way through the second chunk
+static const char kMidChunk[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "6\r\nhello \r\n"
+    "6\r\nwor";
+
+// Cut off after the second chunk, before the last one
+static const char kBetweenChunks[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "6\r\nhello \r\n"
+    "6\r\nworld\n\r\n";
+
+// "hello world, hello world, hello world\n" three times, gzipped
+static const uint8_t kGzipped[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xcb, 0x48, 0xcd, 0xc9,
+    0xc9, 0x57, 0x28, 0xcf, 0x2f, 0xca, 0x49, 0xd1, 0x51, 0xc8, 0xc0, 0xc1, 0xe1, 0xca,
+    0xa0, 0xa2, 0x2a, 0x00, 0x96, 0xb8, 0x77, 0x77, 0x72, 0x00, 0x00, 0x00
+};
+
+static uint8_t gWindow[32768];
+
+static void begin(MockStream& aMock, HttpStream& aHttp, HttpYieldClock& aClock)
+{
+    aMock.setFragments(3);
+    aHttp.setClock(&aClock);
+    aHttp.setTimeout(10);
+}
+
+static void testResponseBody(const char* aResponse, size_t aReceived)
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpYieldClock clock;
+    CapturePrint body;
+
+    mock.setData(aResponse);
+    begin(mock, http, clock);
+
+    CHECK_EQUAL(HTTP_SUCCESS, http.get("/"));
+    CHECK_EQUAL(200, http.responseStatusCode());
+    CHECK_EQUAL(HTTP_ERROR_TIMED_OUT, http.responseBody(body));
+    CHECK_EQUAL(aReceived, body.iLength);
+    CHECK(!http.endOfBodyReached());
+}
+
+static void testDownload(const char* aResponse, size_t aReceived)
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpYieldClock clock;
+    HttpDownload download;
+    CapturePrint body;
+
+    mock.setData(aResponse);
+    begin(mock, http, clock);
+
+    CHECK_EQUAL(HTTP_ERROR_TIMED_OUT, http.download("/", body, download));
+    CHECK_EQUAL(aReceived, download.offset());
+    CHECK_EQUAL(aReceived, body.iLength);
+}
+
+static void testGzipped(bool aChunked)
+{
+    MockStream mock;
+    HttpStream http(mock);
+    HttpYieldClock clock;
+    Inflater inflater(gWindow, sizeof(gWindow));
+    CapturePrint body;
+    uint8_t response[256];
+    size_t length = 0;
+    // Leave off the end of the compressed data
+    const size_t kSent = 20;
+
+    if (aChunked)
+    {
+        length = sprintf((char*)response,
+                         "HTTP/1.1 200 OK\r\n"
+                         "Content-Encoding: gzip\r\n"
+                         "Transfer-Encoding: chunked\r\n"
+                         "\r\n"
+                         "%x\r\n", (unsigned)sizeof(kGzipped));
+    }
+    else
+    {
+        length = sprintf((char*)response,
+                         "HTTP/1.1 200 OK\r\n"
+                         "Content-Encoding: gzip\r\n"
+                         "\r\n");
+    }
+    memcpy(response + length, kGzipped, kSent);
+    length += kSent;
+
+    mock.setData(response, length);
+    begin(mock, http, clock);
+    http.setInflater(&inflater);
+
+    CHECK_EQUAL(HTTP_SUCCESS, http.get("/"));
+    CHECK_EQUAL(200, http.responseStatusCode());
+    CHECK_EQUAL(HTTP_ERROR_TIMED_OUT, http.responseBody(body));
+    CHECK(http.isResponseCompressed());
+    CHECK(!http.endOfBodyReached());
+}
+
+int main()
+{
+    testResponseBody(kMidChunk, 9);
+    testResponseBody(kBetweenChunks, 12);
+    testDownload(kMidChunk, 9);
+    testDownload(kBetweenChunks, 12);
+    testGzipped(true);
+    testGzipped(false);
+    return gFailures;
+}
@@ -6,6 +6,10 @@
 #define ArduinoHttpStream_h
 
 #include "HttpStream.h"
+#include "HttpStreamPool.h"
+#include "HttpMultipart.h"
+#include "HttpForm.h"
+#include "HttpJsonReader.h"
 #include "WebSocketStream.h"
 #include "URLEncoder.h"
 
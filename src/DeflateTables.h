@@ -0,0 +1,19 @@
+// Tables shared by Inflater and Deflater
+// Released under Apache License, version 2.0
+
+#ifndef DeflateTables_h
+#define DeflateTables_h
+
+#include <Arduino.h>
+
+// Lengths and distances are sent as a symbol giving a base value, followed
+// by some extra bits to add to it (RFC 1951 section 3.2.5).  They're kept in
+// flash, so read them with pgm_read_word() and pgm_read_byte()
+static const int kDeflateLengthCodes = 29;
+static const int kDeflateDistanceCodes = 30;
+extern const uint16_t kDeflateLengthBase[kDeflateLengthCodes];
+extern const uint8_t kDeflateLengthExtraBits[kDeflateLengthCodes];
+extern const uint16_t kDeflateDistanceBase[kDeflateDistanceCodes];
+extern const uint8_t kDeflateDistanceExtraBits[kDeflateDistanceCodes];
+
+#endif
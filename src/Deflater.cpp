@@ -0,0 +1,332 @@
+// Class to compress data with deflate, in zlib format, a piece at a time
+// Released under Apache License, version 2.0
+
+#include "Deflater.h"
+#include "DeflateTables.h"
+
+// Print which just counts what's written to it
+class LengthCounter : public Print
+{
+public:
+    LengthCounter() : iLength(0) {};
+    virtual size_t write(uint8_t) { iLength++; return 1; };
+    virtual size_t write(const uint8_t*, size_t aSize) { iLength += aSize; return aSize; };
+
+    size_t iLength;
+};
+
+Deflater::Deflater(uint8_t* aWindow, size_t aWindowSize)
+ : iOutput(NULL), iDictionary(NULL), iDictionaryLength(0), iWindow(aWindow),
+   iWindowSize((aWindowSize < kMaxWindowSize) ? aWindowSize : kMaxWindowSize),
+   iWindowLength(0), iPending(0), iAdler(1), iBitBuffer(0), iBitCount(0),
+   iOutLength(0), iWriteOk(true)
+{
+    memset(iHashHeads, 0, sizeof(iHashHeads));
+}
+
+void Deflater::setDictionary(const uint8_t* aDictionary, size_t aLength)
+{
+    iDictionary = aDictionary;
+    iDictionaryLength = aDictionary ? aLength : 0;
+}
+
+void Deflater::begin(Print& aOutput)
+{
+    iOutput = &aOutput;
+    iWindowLength = 0;
+    iPending = 0;
+    iAdler = 1;
+    iBitBuffer = 0;
+    iBitCount = 0;
+    iOutLength = 0;
+    iWriteOk = true;
+    memset(iHashHeads, 0, sizeof(iHashHeads));
+
+    if (iDictionary)
+    {
+        // Start with the end of the dictionary in the window, as if it had
+        // just been compressed, so that the data can refer back to it
+        size_t length = (iDictionaryLength < iWindowSize / 2) ? iDictionaryLength : iWindowSize / 2;
+
+        memcpy(iWindow, iDictionary + iDictionaryLength - length, length);
+        iWindowLength = length;
+        iPending = length;
+        for (size_t i = 0; i < length; i++)
+        {
+            insertHash(i);
+        }
+    }
+
+    // zlib header, giving the compression method and how far back we'll
+    // refer, with a check value to make it a multiple of 31
+    uint8_t windowBits = 0;
+
+    while ((256UL << windowBits) < iWindowSize)
+    {
+        windowBits++;
+    }
+
+    uint8_t method = (windowBits << 4) | 8;
+    uint8_t flags = iDictionary ? 0x20 : 0;
+
+    flags |= 31 - (((method << 8) | flags) % 31);
+    writeBits(method, 8);
+    writeBits(flags, 8);
+    if (iDictionary)
+    {
+        // The receiver uses this to check it has the same dictionary
+        writeLong(adler32(1, iDictionary, iDictionaryLength));
+    }
+
+    // Everything goes in a single, final, block using the fixed Huffman
+    // codes.  Our output is too short to gain much from building codes of
+    // our own
+    writeBits(1, 1);
+    writeBits(1, 2);
+}
+
+size_t Deflater::write(const uint8_t *aBuffer, size_t aSize)
+{
+    iAdler = adler32(iAdler, aBuffer, aSize);
+
+    size_t remaining = aSize;
+
+    while (remaining > 0)
+    {
+        if (iWindowLength == iWindowSize)
+        {
+            // Full, so compress what's there and move the second half of it
+            // down to make room for more, where it can still be referred to
+            compressPending();
+
+            size_t shift = iWindowLength - iWindowSize / 2;
+
+            memmove(iWindow, iWindow + shift, iWindowLength - shift);
+            iWindowLength -= shift;
+            iPending -= shift;
+            for (int i = 0; i < kHashSize; i++)
+            {
+                iHashHeads[i] = (iHashHeads[i] > shift) ? iHashHeads[i] - shift : 0;
+            }
+        }
+
+        size_t toCopy = iWindowSize - iWindowLength;
+
+        if (remaining < toCopy)
+        {
+            toCopy = remaining;
+        }
+        memcpy(iWindow + iWindowLength, aBuffer, toCopy);
+        iWindowLength += toCopy;
+        aBuffer += toCopy;
+        remaining -= toCopy;
+    }
+    return aSize;
+}
+
+bool Deflater::end()
+{
+    compressPending();
+    // End of the block, then the checksum starting at the next byte
+    writeLiteral(256);
+    if (iBitCount > 0)
+    {
+        writeBits(0, 8 - iBitCount);
+    }
+    writeLong(iAdler);
+    flushOutput();
+    return iWriteOk;
+}
+
+size_t Deflater::compressedLength(const uint8_t* aData, size_t aLength)
+{
+    LengthCounter counter;
+
+    begin(counter);
+    write(aData, aLength);
+    end();
+    return counter.iLength;
+}
+
+void Deflater::compressPending()
+{
+    size_t pos = iPending;
+
+    while (pos < iWindowLength)
+    {
+        // See if the data here starts the same as the last data which had
+        // the same hash
+        uint16_t length = 0;
+        size_t match = 0;
+
+        if (pos + kMinMatch <= iWindowLength)
+        {
+            uint16_t hash = hashAt(pos);
+
+            if (iHashHeads[hash])
+            {
+                size_t maxLength = iWindowLength - pos;
+
+                if (maxLength > kMaxMatch)
+                {
+                    maxLength = kMaxMatch;
+                }
+                match = iHashHeads[hash] - 1;
+                while ((length < maxLength) && (iWindow[match + length] == iWindow[pos + length]))
+                {
+                    length++;
+                }
+            }
+            iHashHeads[hash] = pos + 1;
+        }
+
+        if (length >= kMinMatch)
+        {
+            writeMatch(length, pos - match);
+            // Remember where the rest of the repeated data was too
+            for (size_t i = pos + 1; i < pos + length; i++)
+            {
+                insertHash(i);
+            }
+            pos += length;
+        }
+        else
+        {
+            writeLiteral(iWindow[pos]);
+            pos++;
+        }
+    }
+    iPending = pos;
+}
+
+uint16_t Deflater::hashAt(size_t aPos)
+{
+    uint32_t bytes = ((uint32_t)iWindow[aPos] << 16) | (iWindow[aPos+1] << 8) | iWindow[aPos+2];
+
+    // Multiply by a large prime to mix the bits into the top of the result
+    return (uint32_t)(bytes * 2654435761UL) >> (32 - DEFLATER_HASH_BITS);
+}
+
+void Deflater::insertHash(size_t aPos)
+{
+    if (aPos + kMinMatch <= iWindowLength)
+    {
+        iHashHeads[hashAt(aPos)] = aPos + 1;
+    }
+}
+
+void Deflater::writeLiteral(uint16_t aSymbol)
+{
+    // The fixed Huffman code, from RFC 1951 section 3.2.6
+    if (aSymbol < 144)
+    {
+        writeCode(0x30 + aSymbol, 8);
+    }
+    else if (aSymbol < 256)
+    {
+        writeCode(0x190 + aSymbol - 144, 9);
+    }
+    else if (aSymbol < 280)
+    {
+        writeCode(aSymbol - 256, 7);
+    }
+    else
+    {
+        writeCode(0xc0 + aSymbol - 280, 8);
+    }
+}
+
+void Deflater::writeMatch(uint16_t aLength, uint16_t aDistance)
+{
+    int code = kDeflateLengthCodes - 1;
+
+    while (pgm_read_word(&kDeflateLengthBase[code]) > aLength)
+    {
+        code--;
+    }
+    writeLiteral(257 + code);
+    writeBits(aLength - pgm_read_word(&kDeflateLengthBase[code]),
+              pgm_read_byte(&kDeflateLengthExtraBits[code]));
+
+    code = kDeflateDistanceCodes - 1;
+    while (pgm_read_word(&kDeflateDistanceBase[code]) > aDistance)
+    {
+        code--;
+    }
+    // The fixed distance codes are just the code in 5 bits
+    writeCode(code, 5);
+    writeBits(aDistance - pgm_read_word(&kDeflateDistanceBase[code]),
+              pgm_read_byte(&kDeflateDistanceExtraBits[code]));
+}
+
+void Deflater::writeCode(uint16_t aCode, uint8_t aCount)
+{
+    uint16_t reversed = 0;
+
+    for (uint8_t i = 0; i < aCount; i++)
+    {
+        reversed = (reversed << 1) | (aCode & 1);
+        aCode >>= 1;
+    }
+    writeBits(reversed, aCount);
+}
+
+void Deflater::writeBits(uint32_t aBits, uint8_t aCount)
+{
+    iBitBuffer |= aBits << iBitCount;
+    iBitCount += aCount;
+
+    while (iBitCount >= 8)
+    {
+        iOutBuffer[iOutLength++] = iBitBuffer & 0xff;
+        iBitBuffer >>= 8;
+        iBitCount -= 8;
+
+        if (iOutLength == sizeof(iOutBuffer))
+        {
+            flushOutput();
+        }
+    }
+}
+
+void Deflater::writeLong(uint32_t aValue)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        writeBits((aValue >> shift) & 0xff, 8);
+    }
+}
+
+void Deflater::flushOutput()
+{
+    if ((iOutLength > 0) && iOutput)
+    {
+        if (iOutput->write(iOutBuffer, iOutLength) != iOutLength)
+        {
+            iWriteOk = false;
+        }
+    }
+    iOutLength = 0;
+}
+
+uint32_t Deflater::adler32(uint32_t aAdler, const uint8_t* aData, size_t aLength)
+{
+    uint32_t sum1 = aAdler & 0xffff;
+    uint32_t sum2 = aAdler >> 16;
+
+    while (aLength > 0)
+    {
+        // 5552 bytes is as many as we can add up before sum2 could overflow
+        size_t count = (aLength < 5552) ? aLength : 5552;
+
+        aLength -= count;
+        while (count--)
+        {
+            sum1 += *aData++;
+            sum2 += sum1;
+        }
+        sum1 %= 65521;
+        sum2 %= 65521;
+    }
+    return (sum2 << 16) | sum1;
+}
@@ -0,0 +1,121 @@
+// Class to compress data with deflate, in zlib format, a piece at a time
+// Released under Apache License, version 2.0
+
+#ifndef Deflater_h
+#define Deflater_h
+
+#include <Arduino.h>
+
+// Number of bits in the hash used to find repeated data.  The hash table
+// takes 2 bytes for each entry
+#ifndef DEFLATER_HASH_BITS
+#define DEFLATER_HASH_BITS 8
+#endif
+
+class Deflater : public Print
+{
+public:
+    /** Create a Deflater which collects the data to compress in aWindow.
+      Repeats are only found within aWindow, so a bigger one compresses
+      better.  Anything over 32KB isn't used.
+      @param aWindow      Buffer for the data being compressed
+      @param aWindowSize  Size of aWindow
+    */
+    Deflater(uint8_t* aWindow, size_t aWindowSize);
+
+    /** Use a preset dictionary for everything compressed from the next call
+      to begin().  The receiver needs to have the same dictionary, which
+      should contain strings likely to appear in the data, the most likely
+      at the end.  Only as much of the end of the dictionary as fits in half
+      of the window is used.  aDictionary isn't copied, so it must stay
+      around until begin() has been called.
+      @param aDictionary  The dictionary, or NULL for none
+      @param aLength      Length of aDictionary
+    */
+    void setDictionary(const uint8_t* aDictionary, size_t aLength);
+
+    /** Start compressing data, sending the result to aOutput
+    */
+    void begin(Print& aOutput);
+
+    /** Compress whatever is left and finish off the compressed data
+      @return true if it could all be written to aOutput
+    */
+    bool end();
+
+    /** Work out how long aData will be once compressed, e.g. to send it with
+      a Content-Length header.  This uses the same window, so it mustn't be
+      called whilst compressing something else.
+      @return Length of the compressed data
+    */
+    size_t compressedLength(const uint8_t* aData, size_t aLength);
+
+    // Inherited from Print
+    virtual size_t write(uint8_t aByte) { return write(&aByte, 1); };
+    virtual size_t write(const uint8_t *aBuffer, size_t aSize);
+
+protected:
+    /* Compress the data in iWindow from iPending on
+    */
+    void compressPending();
+    /* Return the hash of the 3 bytes at aPos in iWindow
+    */
+    uint16_t hashAt(size_t aPos);
+    /* Add the position aPos in iWindow to the hash table
+    */
+    void insertHash(size_t aPos);
+    /* Write a literal byte or a length with the fixed Huffman code
+    */
+    void writeLiteral(uint16_t aSymbol);
+    /* Write a length and distance back to the data to repeat
+    */
+    void writeMatch(uint16_t aLength, uint16_t aDistance);
+    /* Write the aCount bits of aCode, most significant first, as Huffman
+      codes are
+    */
+    void writeCode(uint16_t aCode, uint8_t aCount);
+    /* Write the aCount bits of aBits, least significant first
+    */
+    void writeBits(uint32_t aBits, uint8_t aCount);
+    /* Write the 4 bytes of aValue, most significant first
+    */
+    void writeLong(uint32_t aValue);
+    /* Send whatever is in iOutBuffer to iOutput
+    */
+    void flushOutput();
+    /* Add aLength bytes of aData to the Adler-32 checksum aAdler
+    */
+    static uint32_t adler32(uint32_t aAdler, const uint8_t* aData, size_t aLength);
+
+    static const int kHashSize = 1 << DEFLATER_HASH_BITS;
+    static const uint16_t kMinMatch = 3;
+    static const uint16_t kMaxMatch = 258;
+    static const size_t kMaxWindowSize = 32768;
+
+    // Where the compressed data goes
+    Print* iOutput;
+    // Preset dictionary, if any
+    const uint8_t* iDictionary;
+    size_t iDictionaryLength;
+    // Data being compressed, following on from what's already been
+    // compressed so that repeats of it can be found
+    uint8_t* iWindow;
+    size_t iWindowSize;
+    size_t iWindowLength;
+    // Where the data we haven't compressed yet starts in iWindow
+    size_t iPending;
+    // One more than the last position in iWindow with each hash, or 0
+    uint16_t iHashHeads[kHashSize];
+    // Adler-32 checksum of the data so far
+    uint32_t iAdler;
+    // Compressed bits waiting to make up a whole byte
+    uint32_t iBitBuffer;
+    uint8_t iBitCount;
+    // Compressed bytes waiting to be sent
+    uint8_t iOutBuffer[16];
+    uint8_t iOutLength;
+    // Whether all of the output has been accepted by iOutput
+    bool iWriteOk;
+};
+
+#endif
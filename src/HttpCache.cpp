@@ -0,0 +1,344 @@
+// Classes to keep responses so HttpStream can ask the server whether they've
+// changed, rather than downloading them again
+// Released under Apache License, version 2.0
+
+#include "HttpCache.h"
+
+HttpMemoryCache::HttpMemoryCache(uint8_t* aBuffer, size_t aSize)
+ : iBuffer(aBuffer), iSize(aSize), iLength(0), iPathLength(0), iBodyStart(0),
+   iBodyLength(0), iReadPos(0), iStoreStart(0), iStoreBodyStart(0), iValid(false),
+   iStoring(false)
+{
+}
+
+bool HttpMemoryCache::find(const char* aURLPath)
+{
+    if (iValid && !strcmp((const char*)iBuffer, aURLPath))
+    {
+        // The validators follow the path, and both fitted when it was stored
+        const char* etag = (const char*)iBuffer + iPathLength;
+
+        strcpy(iETag, etag);
+        strcpy(iLastModified, etag + strlen(etag) + 1);
+        iReadPos = 0;
+        return true;
+    }
+
+    // It's a different path, so whatever we had is about to be replaced.
+    // Keep hold of the path ready for the new response
+    iValid = false;
+    iLength = 0;
+    iPathLength = append(aURLPath) ? iLength : 0;
+    iETag[0] = '\0';
+    iLastModified[0] = '\0';
+    return false;
+}
+
+bool HttpMemoryCache::beginStore(long aLength)
+{
+    iStoring = false;
+    if (iPathLength == 0)
+    {
+        // We couldn't even fit the path in
+        return false;
+    }
+
+    // Put it after the response we've got, so that one is still there if
+    // this one doesn't all arrive
+    iLength = iValid ? iBodyStart + iBodyLength : iPathLength;
+    iStoreStart = iLength;
+    iStoreBodyStart = iLength;
+
+    if (!makeRoom(strlen(iETag) + strlen(iLastModified) + 2))
+    {
+        endStore(false);
+        return false;
+    }
+    append(iETag);
+    append(iLastModified);
+    iStoreBodyStart = iLength;
+
+    if ((aLength >= 0) && (((unsigned long)aLength > iSize) || !makeRoom((size_t)aLength)))
+    {
+        // No point starting, it won't fit
+        endStore(false);
+        return false;
+    }
+    iStoring = true;
+    return true;
+}
+
+bool HttpMemoryCache::store(const uint8_t* aData, size_t aLength)
+{
+    if (!iStoring || !makeRoom(aLength))
+    {
+        iStoring = false;
+        return false;
+    }
+    memcpy(iBuffer + iLength, aData, aLength);
+    iLength += aLength;
+    return true;
+}
+
+void HttpMemoryCache::endStore(bool aComplete)
+{
+    if (iStoring && aComplete)
+    {
+        // Replace the old one with it
+        moveDown();
+        iBodyStart = iStoreBodyStart;
+        iBodyLength = iLength - iBodyStart;
+        iValid = true;
+    }
+    else if (iValid)
+    {
+        // Forget the new one, and keep the old one
+        iLength = iBodyStart + iBodyLength;
+    }
+    else
+    {
+        iBodyLength = 0;
+    }
+    iReadPos = 0;
+    iStoring = false;
+}
+
+bool HttpMemoryCache::beginRead()
+{
+    iReadPos = 0;
+    return iValid;
+}
+
+int HttpMemoryCache::read(uint8_t* aBuffer, size_t aSize)
+{
+    if (!iValid)
+    {
+        return 0;
+    }
+
+    size_t toRead = iBodyLength - iReadPos;
+
+    if (aSize < toRead)
+    {
+        toRead = aSize;
+    }
+    memcpy(aBuffer, iBuffer + iBodyStart + iReadPos, toRead);
+    iReadPos += toRead;
+    return toRead;
+}
+
+bool HttpMemoryCache::makeRoom(size_t aLength)
+{
+    if (aLength <= iSize - iLength)
+    {
+        return true;
+    }
+    else if ((iStoreStart == iPathLength) || (aLength > iSize - iLength + (iStoreStart - iPathLength)))
+    {
+        // It won't fit, even on its own
+        return false;
+    }
+
+    // There's only room for the new one, so the old one has to go
+    iValid = false;
+    moveDown();
+    return true;
+}
+
+void HttpMemoryCache::moveDown()
+{
+    size_t offset = iStoreStart - iPathLength;
+
+    memmove(iBuffer + iPathLength, iBuffer + iStoreStart, iLength - iStoreStart);
+    iLength -= offset;
+    iStoreBodyStart -= offset;
+    iStoreStart = iPathLength;
+}
+
+bool HttpMemoryCache::append(const char* aText)
+{
+    size_t length = strlen(aText) + 1;
+
+    if (length > iSize - iLength)
+    {
+        return false;
+    }
+    memcpy(iBuffer + iLength, aText, length);
+    iLength += length;
+    return true;
+}
+
+#ifndef ARDUINO
+// The file for each path is named after a hash of it, as the path itself
+// could be too long or contain characters the filesystem won't allow.  The
+// path is kept in the file too, in case two of them have the same hash
+static unsigned long hashPath(const char* aURLPath)
+{
+    // 32-bit FNV-1a
+    unsigned long hash = 2166136261UL;
+
+    while (*aURLPath)
+    {
+        hash = ((hash ^ (uint8_t)*aURLPath++) * 16777619UL) & 0xffffffffUL;
+    }
+    return hash;
+}
+
+HttpFileCache::HttpFileCache(const char* aDirectory)
+ : iDirectory(aDirectory), iFile(NULL), iBodyStart(0), iRemaining(0)
+{
+    iPath[0] = '\0';
+    iFileName[0] = '\0';
+}
+
+HttpFileCache::~HttpFileCache()
+{
+    close();
+}
+
+bool HttpFileCache::find(const char* aURLPath)
+{
+    close();
+    iETag[0] = '\0';
+    iLastModified[0] = '\0';
+    iPath[0] = '\0';
+
+    if (strlen(aURLPath) >= sizeof(iPath))
+    {
+        // Too long to keep, so it won't be stored either
+        return false;
+    }
+    strcpy(iPath, aURLPath);
+    snprintf(iFileName, sizeof(iFileName), "%s/%08lx.cache", iDirectory, hashPath(iPath));
+
+    iFile = fopen(iFileName, "rb");
+    if (!iFile)
+    {
+        return false;
+    }
+
+    // The file starts with a line each for the path and the validators
+    char path[sizeof(iPath)];
+
+    if (!readLine(path, sizeof(path)) || strcmp(path, iPath) ||
+        !readLine(iETag, sizeof(iETag)) || !readLine(iLastModified, sizeof(iLastModified)))
+    {
+        // It's for another path, or it's damaged
+        iETag[0] = '\0';
+        iLastModified[0] = '\0';
+        close();
+        return false;
+    }
+
+    iBodyStart = ftell(iFile);
+    return true;
+}
+
+bool HttpFileCache::beginStore(long)
+{
+    close();
+    if (!iPath[0])
+    {
+        return false;
+    }
+
+    // Write it to one side, so the old one is still there if this one
+    // doesn't all arrive
+    char tempName[sizeof(iFileName) + 4];
+
+    snprintf(tempName, sizeof(tempName), "%s.tmp", iFileName);
+    iFile = fopen(tempName, "wb");
+    if (!iFile)
+    {
+        return false;
+    }
+
+    if (fprintf(iFile, "%s\n%s\n%s\n", iPath, iETag, iLastModified) < 0)
+    {
+        endStore(false);
+        return false;
+    }
+    return true;
+}
+
+bool HttpFileCache::store(const uint8_t* aData, size_t aLength)
+{
+    return iFile && (fwrite(aData, 1, aLength, iFile) == aLength);
+}
+
+void HttpFileCache::endStore(bool aComplete)
+{
+    if (!iFile)
+    {
+        return;
+    }
+
+    char tempName[sizeof(iFileName) + 4];
+
+    snprintf(tempName, sizeof(tempName), "%s.tmp", iFileName);
+    if ((fclose(iFile) == 0) && aComplete)
+    {
+        rename(tempName, iFileName);
+    }
+    else
+    {
+        remove(tempName);
+    }
+    iFile = NULL;
+}
+
+bool HttpFileCache::beginRead()
+{
+    if (!iFile || fseek(iFile, 0, SEEK_END))
+    {
+        return false;
+    }
+    iRemaining = ftell(iFile) - iBodyStart;
+    return (iRemaining >= 0) && !fseek(iFile, iBodyStart, SEEK_SET);
+}
+
+int HttpFileCache::read(uint8_t* aBuffer, size_t aSize)
+{
+    if (!iFile || (iRemaining <= 0))
+    {
+        return 0;
+    }
+
+    if ((unsigned long)iRemaining < aSize)
+    {
+        aSize = iRemaining;
+    }
+
+    size_t ret = fread(aBuffer, 1, aSize, iFile);
+
+    iRemaining -= ret;
+    return ret;
+}
+
+void HttpFileCache::close()
+{
+    if (iFile)
+    {
+        fclose(iFile);
+        iFile = NULL;
+    }
+    iRemaining = 0;
+}
+
+bool HttpFileCache::readLine(char* aBuffer, size_t aSize)
+{
+    if (!fgets(aBuffer, aSize, iFile))
+    {
+        return false;
+    }
+
+    char* end = strchr(aBuffer, '\n');
+
+    if (!end)
+    {
+        return false;
+    }
+    *end = '\0';
+    return true;
+}
+#endif
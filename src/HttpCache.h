@@ -0,0 +1,188 @@
+// Classes to keep responses so HttpStream can ask the server whether they've
+// changed, rather than downloading them again
+// Released under Apache License, version 2.0
+
+#ifndef HttpCache_h
+#define HttpCache_h
+
+#include <Arduino.h>
+
+// Space for each of the ETag and Last-Modified values of a cached response
+#ifndef HTTP_CACHE_VALIDATOR_SIZE
+#define HTTP_CACHE_VALIDATOR_SIZE 48
+#endif
+
+// Somewhere to keep responses to GET requests, given to
+// HttpStream::setCache().  HttpStream looks up each path with find(), and if
+// it's there asks the server to only send it if it has changed since.  If
+// it hasn't the body is read back from here, otherwise the new one is
+// stored.  Subclasses decide where it all goes.  Each HttpStream needs a
+// cache of its own, as the calls refer to whichever path was last found.
+class HttpCache
+{
+public:
+    HttpCache() { iETag[0] = '\0'; iLastModified[0] = '\0'; };
+    virtual ~HttpCache() {};
+
+    /** Look for a stored response for aURLPath, and make it the one the
+      rest of the calls refer to
+      @return true if there is one, with its validators in etag() and
+      lastModified()
+    */
+    virtual bool find(const char* aURLPath) = 0;
+
+    /** Start replacing the response for the path given to find() with a new
+      one, whose validators are in etag() and lastModified()
+      @param aLength  Length of the body, or -1 if it isn't known
+      @return false if it can't be stored, e.g. it's too big
+    */
+    virtual bool beginStore(long aLength) = 0;
+
+    /** Add aLength bytes of aData to the body being stored
+      @return false if it can't all be stored
+    */
+    virtual bool store(const uint8_t* aData, size_t aLength) = 0;
+
+    /** Finish storing the body
+      @param aComplete  false if it didn't all arrive, so mustn't be used
+    */
+    virtual void endStore(bool aComplete) = 0;
+
+    /** Start reading back the body of the response found by find()
+      @return false if it can't be read
+    */
+    virtual bool beginRead() = 0;
+
+    /** Read up to aSize bytes of the body into aBuffer
+      @return Number of bytes read, 0 at the end of the body
+    */
+    virtual int read(uint8_t* aBuffer, size_t aSize) = 0;
+
+    /** Return the number of bytes of the body left to read
+    */
+    virtual long available() = 0;
+
+    /** Return the ETag of the response, or "" if it didn't have one
+    */
+    const char* etag() { return iETag; };
+
+    /** Return the Last-Modified time of the response, or "" if it didn't
+      have one
+    */
+    const char* lastModified() { return iLastModified; };
+
+protected:
+    friend class HttpStream;
+
+    // Validators of the response found, or of the response being stored
+    char iETag[HTTP_CACHE_VALIDATOR_SIZE];
+    char iLastModified[HTTP_CACHE_VALIDATOR_SIZE];
+};
+
+// Keeps the most recent response in a buffer in RAM.  Polling the same path
+// over and over is the case it's meant for, a response for another path
+// replaces it.  A new version of the response is stored after the old one,
+// which is only replaced once the new one has all arrived, so make aBuffer
+// big enough for two if an old copy should survive a refresh that gets cut
+// off.  If there isn't room for both the old one makes way for the new one.
+class HttpMemoryCache : public HttpCache
+{
+public:
+    /** Create a cache which keeps a response in aBuffer
+      @param aBuffer  Space for the path, validators and body of the response
+      @param aSize    Size of aBuffer
+    */
+    HttpMemoryCache(uint8_t* aBuffer, size_t aSize);
+
+    virtual bool find(const char* aURLPath);
+    virtual bool beginStore(long aLength);
+    virtual bool store(const uint8_t* aData, size_t aLength);
+    virtual void endStore(bool aComplete);
+    virtual bool beginRead();
+    virtual int read(uint8_t* aBuffer, size_t aSize);
+    virtual long available() { return iBodyLength - iReadPos; };
+
+protected:
+    /* Add the string aText to iBuffer at iLength, including its '\0'
+      @return false if it doesn't fit
+    */
+    bool append(const char* aText);
+
+    /* Make sure there's space for aLength more bytes of the response being
+      stored, getting rid of the old one if need be
+      @return false if it won't fit
+    */
+    bool makeRoom(size_t aLength);
+
+    /* Move the response being stored down to straight after the path
+    */
+    void moveDown();
+
+    // The path, the validators and then the body, one after the other
+    uint8_t* iBuffer;
+    size_t iSize;
+    // How much of iBuffer is in use
+    size_t iLength;
+    // Length of the path at the start of iBuffer, including its '\0', or 0
+    // if it didn't fit
+    size_t iPathLength;
+    // Where the body starts in iBuffer, and how long it is
+    size_t iBodyStart;
+    size_t iBodyLength;
+    // How far through the body we've read
+    size_t iReadPos;
+    // Where the validators and the body of the response being stored start
+    // in iBuffer, which is after the old response if there's room
+    size_t iStoreStart;
+    size_t iStoreBodyStart;
+    // Whether iBuffer holds a complete response
+    bool iValid;
+    // Whether the body being stored has all fitted so far
+    bool iStoring;
+};
+
+#ifndef ARDUINO
+#include <stdio.h>
+
+// Keeps each response in a file of its own in a directory, for builds with
+// a filesystem that stdio can use, e.g. on a host
+class HttpFileCache : public HttpCache
+{
+public:
+    /** Create a cache which keeps its files in aDirectory, which must
+      already exist
+    */
+    HttpFileCache(const char* aDirectory);
+    ~HttpFileCache();
+
+    virtual bool find(const char* aURLPath);
+    virtual bool beginStore(long aLength);
+    virtual bool store(const uint8_t* aData, size_t aLength);
+    virtual void endStore(bool aComplete);
+    virtual bool beginRead();
+    virtual int read(uint8_t* aBuffer, size_t aSize);
+    virtual long available() { return iRemaining; };
+
+protected:
+    /* Close iFile, if it's open
+    */
+    void close();
+    /* Read a line of the file's header into aBuffer
+      @return false if it's missing or too long
+    */
+    bool readLine(char* aBuffer, size_t aSize);
+
+    const char* iDirectory;
+    // Path of the response found, and the file it's kept in
+    char iPath[256];
+    char iFileName[320];
+    // The file being read or written
+    FILE* iFile;
+    // Where the body starts in iFile, and how many bytes of it are left to
+    // read
+    long iBodyStart;
+    long iRemaining;
+};
+#endif
+
+#endif
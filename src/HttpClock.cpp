@@ -0,0 +1,26 @@
+// Clocks used by HttpStream to tell the time and to wait for data
+// Released under Apache License, version 2.0
+
+#include "HttpClock.h"
+
+unsigned long HttpClock::now()
+{
+    return millis();
+}
+
+void HttpClock::wait(unsigned long aMillis)
+{
+    if (aMillis)
+    {
+        delay(aMillis);
+    }
+    else
+    {
+        yield();
+    }
+}
+
+void HttpYieldClock::wait(unsigned long)
+{
+    yield();
+}
@@ -0,0 +1,55 @@
+// Clocks used by HttpStream to tell the time and to wait for data
+// Released under Apache License, version 2.0
+
+#ifndef HttpClock_h
+#define HttpClock_h
+
+#include <Arduino.h>
+
+// Tells the time and waits whilst there's no data to read.  This one uses
+// millis() and delay(), as HttpStream always used to.  Make a subclass to
+// do it some other way, e.g. to give the time to an RTOS task, or to move
+// a simulated clock on in tests, and pass it to HttpStream::setClock()
+class HttpClock
+{
+public:
+    virtual ~HttpClock() {};
+
+    /** Return the time now, in milliseconds
+    */
+    virtual unsigned long now();
+
+    /** Wait whilst there's no data, for up to aMillis.  It's fine to return
+      sooner, it'll be called again if there's still no data
+      @param aMillis  Longest it's worth waiting, or 0 just to let anything
+                      else which needs to run have a turn
+    */
+    virtual void wait(unsigned long aMillis);
+};
+
+// Calls yield() rather than delay(), so the rest of the sketch, or other
+// tasks with a cooperative scheduler, can keep running and data is noticed
+// as soon as it arrives
+class HttpYieldClock : public HttpClock
+{
+public:
+    virtual void wait(unsigned long aMillis);
+};
+
+// Hands the waiting over to a function, e.g. one which calls vTaskDelay()
+class HttpCallbackClock : public HttpClock
+{
+public:
+    typedef void (*tWaitFunction)(unsigned long aMillis, void* aContext);
+
+    HttpCallbackClock(tWaitFunction aWait, void* aContext = NULL)
+     : iWait(aWait), iContext(aContext) {};
+
+    virtual void wait(unsigned long aMillis) { iWait(aMillis, iContext); };
+
+protected:
+    tWaitFunction iWait;
+    void* iContext;
+};
+
+#endif
@@ -0,0 +1,446 @@
+// C++20 coroutine versions of the HttpStream and WebSocketStream calls which
+// wait for the server, for builds with a compiler which supports them
+// Released under Apache License, version 2.0
+//
+// Write each exchange as a coroutine returning HttpTask, and co_await the
+// waiting parts of it:
+//
+//   HttpTask fetch(HttpStream& aHttp)
+//   {
+//       aHttp.get("/");
+//       int status = co_await awaitStatus(aHttp);
+//       co_await awaitHeaders(aHttp);
+//       uint8_t block[64];
+//       int count;
+//       while ((count = co_await awaitBody(aHttp, block, sizeof(block))) > 0)
+//       {
+//           // ...use block...
+//       }
+//       co_return status;
+//   }
+//
+//   HttpExecutor executor;
+//   executor.spawn(fetch(http1));
+//   executor.spawn(fetch(http2));
+//   executor.run();
+//
+// Underneath it's the same state machine as poll(), so a coroutine is only
+// resumed once there's something for it, and any number of them can share
+// one thread.  Sending doesn't wait, so the request is made as usual.
+
+#ifndef HttpCoroutine_h
+#define HttpCoroutine_h
+
+#if defined(__has_include)
+#if (__cplusplus >= 202002L) && __has_include(<coroutine>)
+#define HTTP_COROUTINES_SUPPORTED
+#endif
+#endif
+
+#ifdef HTTP_COROUTINES_SUPPORTED
+
+#include <coroutine>
+#include <exception>
+#include "HttpStream.h"
+#include "WebSocketStream.h"
+
+// Longest time in milliseconds that HttpExecutor::run() waits between
+// looking to see if anything has arrived
+#ifndef HTTP_EXECUTOR_POLL_INTERVAL
+#define HTTP_EXECUTOR_POLL_INTERVAL 10
+#endif
+
+class HttpExecutor;
+
+// A coroutine which waits for an HttpStream or WebSocketStream.  It
+// doesn't start until it's given to HttpExecutor::spawn() or awaited by
+// another HttpTask, and its result is the int it co_returns.
+class HttpTask
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> tHandle;
+
+    struct promise_type
+    {
+        // Result given to co_return
+        int iResult = 0;
+        // Executor running this task
+        HttpExecutor* iExecutor = nullptr;
+        // Coroutine awaiting this one, to carry on with when it finishes
+        std::coroutine_handle<> iContinuation;
+        // Whether nothing owns it, so it should tidy itself up at the end
+        bool iDetached = false;
+
+        HttpTask get_return_object() { return HttpTask(tHandle::from_promise(*this)); };
+        std::suspend_always initial_suspend() noexcept { return {}; };
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; };
+            std::coroutine_handle<> await_suspend(tHandle aHandle) noexcept
+            {
+                promise_type& promise = aHandle.promise();
+                std::coroutine_handle<> next = promise.iContinuation;
+
+                if (promise.iDetached)
+                {
+                    aHandle.destroy();
+                }
+                return next ? next : std::noop_coroutine();
+            };
+            void await_resume() noexcept {};
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; };
+
+        void return_value(int aResult) { iResult = aResult; };
+        void unhandled_exception() { std::terminate(); };
+    };
+
+    HttpTask(HttpTask&& aOther) : iHandle(aOther.iHandle) { aOther.iHandle = nullptr; };
+    HttpTask& operator=(HttpTask&& aOther)
+    {
+        if (this != &aOther)
+        {
+            release();
+            iHandle = aOther.iHandle;
+            aOther.iHandle = nullptr;
+        }
+        return *this;
+    };
+    HttpTask(const HttpTask&) = delete;
+    HttpTask& operator=(const HttpTask&) = delete;
+    ~HttpTask() { release(); };
+
+    /** Test whether the task has finished
+    */
+    bool done() { return !iHandle || iHandle.done(); };
+
+    /** Return what the task co_returned, once it's done
+    */
+    int result() { return iHandle ? iHandle.promise().iResult : 0; };
+
+    // Awaiting one task from another runs it, carrying on with the awaiting
+    // one once it has finished
+    bool await_ready() { return done(); };
+    std::coroutine_handle<> await_suspend(tHandle aCaller)
+    {
+        iHandle.promise().iContinuation = aCaller;
+        iHandle.promise().iExecutor = aCaller.promise().iExecutor;
+        return iHandle;
+    };
+    int await_resume() { return result(); };
+
+protected:
+    friend class HttpExecutor;
+
+    explicit HttpTask(tHandle aHandle) : iHandle(aHandle) {};
+
+    void release()
+    {
+        if (iHandle)
+        {
+            if (iHandle.done())
+            {
+                iHandle.destroy();
+            }
+            else
+            {
+                // It's still running, let it tidy itself up when it's done
+                iHandle.promise().iDetached = true;
+            }
+            iHandle = nullptr;
+        }
+    };
+
+    tHandle iHandle;
+};
+
+// Something an HttpTask can wait for.  The executor calls check() each time
+// round until it's ready, or until there's been nothing from the server for
+// the timeout, and then resumes the task with the result.
+class HttpAwaiter
+{
+public:
+    HttpAwaiter(HttpStream& aHttp, unsigned long aTimeout)
+     : iHttp(aHttp), iTimeout(aTimeout), iResult(0), iNext(nullptr) {};
+
+    bool await_ready() { return check(); };
+    void await_suspend(HttpTask::tHandle aHandle);
+    int await_resume() { return iResult; };
+
+protected:
+    friend class HttpExecutor;
+
+    /* See if whatever we're waiting for has happened, and if so set
+      iResult
+      @return true if it has, else false
+    */
+    virtual bool check() = 0;
+
+    /* Give up, as nothing has arrived for too long
+    */
+    virtual void timedOut() { iResult = HTTP_ERROR_TIMED_OUT; };
+
+    HttpStream& iHttp;
+    // How long to wait without anything arriving, or 0 to wait forever
+    unsigned long iTimeout;
+    int iResult;
+    // When something last arrived, and how much had arrived then
+    unsigned long iLastActivity;
+    unsigned long iResponseBytes;
+    // The task waiting for this, and the next in the executor's list
+    std::coroutine_handle<> iHandle;
+    HttpAwaiter* iNext;
+};
+
+// Runs HttpTasks, resuming each of them when what it's waiting for has
+// happened.  Everything happens in run() or runOnce(), on the calling
+// thread, so use one executor per thread to spread the work out.
+class HttpExecutor
+{
+public:
+    HttpExecutor(HttpClock* aClock = nullptr)
+     : iWaiting(nullptr), iClock(aClock ? aClock : &iDefaultClock) {};
+
+    /** Start aTask, which then carries on by itself
+    */
+    void spawn(HttpTask&& aTask)
+    {
+        HttpTask::tHandle handle = aTask.iHandle;
+
+        aTask.iHandle = nullptr;
+        handle.promise().iExecutor = this;
+        handle.promise().iDetached = true;
+        handle.resume();
+    };
+
+    /** Resume any tasks whose wait is over, without waiting for any more
+      @return true if there are still tasks waiting
+    */
+    bool runOnce()
+    {
+        // Take the list, so anything that starts waiting whilst we're going
+        // through it is left for next time
+        HttpAwaiter* waiting = iWaiting;
+
+        iWaiting = nullptr;
+        while (waiting)
+        {
+            HttpAwaiter* awaiter = waiting;
+            bool ready = awaiter->check();
+
+            waiting = awaiter->iNext;
+            if (!ready && timedOut(*awaiter))
+            {
+                awaiter->timedOut();
+                ready = true;
+            }
+
+            if (ready)
+            {
+                awaiter->iHandle.resume();
+            }
+            else
+            {
+                add(awaiter);
+            }
+        }
+        return (iWaiting != nullptr);
+    };
+
+    /** Keep running tasks until they've all finished
+    */
+    void run()
+    {
+        while (runOnce())
+        {
+            iClock->wait(nextWait());
+        }
+    };
+
+    /** Return the time now, from the clock
+    */
+    unsigned long now() { return iClock->now(); };
+
+protected:
+    friend class HttpAwaiter;
+
+    void add(HttpAwaiter* aAwaiter)
+    {
+        aAwaiter->iNext = iWaiting;
+        iWaiting = aAwaiter;
+    };
+
+    /* Work out how long to wait before looking again
+      @return The poll interval, or less if an awaiter will time out before
+      then
+    */
+    unsigned long nextWait()
+    {
+        unsigned long wait = HTTP_EXECUTOR_POLL_INTERVAL;
+
+        for (HttpAwaiter* awaiter = iWaiting; awaiter; awaiter = awaiter->iNext)
+        {
+            if (awaiter->iTimeout)
+            {
+                unsigned long waited = now() - awaiter->iLastActivity;
+                unsigned long left = (waited < awaiter->iTimeout) ? awaiter->iTimeout - waited : 0;
+
+                if (left < wait)
+                {
+                    wait = left;
+                }
+            }
+        }
+        return wait;
+    };
+
+    bool timedOut(HttpAwaiter& aAwaiter)
+    {
+        unsigned long responseBytes = aAwaiter.iHttp.stats().responseBytes;
+
+        if (responseBytes != aAwaiter.iResponseBytes)
+        {
+            // Something has arrived, so start timing again
+            aAwaiter.iResponseBytes = responseBytes;
+            aAwaiter.iLastActivity = now();
+            return false;
+        }
+        return aAwaiter.iTimeout && ((now() - aAwaiter.iLastActivity) >= aAwaiter.iTimeout);
+    };
+
+    // Tasks which are waiting, most recent first
+    HttpAwaiter* iWaiting;
+    HttpClock iDefaultClock;
+    HttpClock* iClock;
+};
+
+inline void HttpAwaiter::await_suspend(HttpTask::tHandle aHandle)
+{
+    HttpExecutor* executor = aHandle.promise().iExecutor;
+
+    iHandle = aHandle;
+    iLastActivity = executor->now();
+    iResponseBytes = iHttp.stats().responseBytes;
+    executor->add(this);
+}
+
+// Waits for the status line, giving the status code or an error
+class HttpStatusAwaiter : public HttpAwaiter
+{
+public:
+    HttpStatusAwaiter(HttpStream& aHttp) : HttpAwaiter(aHttp, aHttp.httpResponseTimeout()) {};
+
+protected:
+    virtual bool check()
+    {
+        int ret = iHttp.poll();
+
+        if (ret == HTTP_POLL_IN_PROGRESS)
+        {
+            return false;
+        }
+        // That's as far as it needs to get, so this won't wait
+        iResult = (ret < 0) ? ret : iHttp.responseStatusCode();
+        return true;
+    };
+};
+
+// Waits for the rest of the headers, giving HTTP_SUCCESS or an error
+class HttpHeadersAwaiter : public HttpAwaiter
+{
+public:
+    HttpHeadersAwaiter(HttpStream& aHttp) : HttpAwaiter(aHttp, aHttp.httpResponseTimeout()) {};
+
+protected:
+    virtual bool check()
+    {
+        int ret;
+
+        do
+        {
+            ret = iHttp.poll();
+        } while (ret == HTTP_POLL_STATUS_READY);
+
+        if (ret == HTTP_POLL_IN_PROGRESS)
+        {
+            return false;
+        }
+        iResult = (ret < 0) ? ret : HTTP_SUCCESS;
+        return true;
+    };
+};
+
+// Waits for some of the body, giving the number of bytes put in the buffer,
+// 0 at the end of the body, or an error
+class HttpBodyAwaiter : public HttpAwaiter
+{
+public:
+    HttpBodyAwaiter(HttpStream& aHttp, uint8_t* aBuffer, size_t aSize)
+     : HttpAwaiter(aHttp, aHttp.getTimeout()), iBuffer(aBuffer), iSize(aSize) {};
+
+protected:
+    virtual bool check()
+    {
+        if (iHttp.endOfBodyReached())
+        {
+            iResult = 0;
+            return true;
+        }
+        // Only take what has arrived, as read() can wait for the rest, e.g.
+        // in WebSocketStream
+        iResult = iHttp.readAvailable(iBuffer, iSize);
+        return (iResult >= 0);
+    };
+
+    virtual void timedOut()
+    {
+        // A body without a length ends when the server stops sending it
+        bool unknownLength = !iHttp.isResponseChunked() &&
+                             (iHttp.contentLength() == HttpStream::kNoContentLengthHeader);
+
+        iResult = unknownLength ? 0 : HTTP_ERROR_TIMED_OUT;
+    };
+
+    uint8_t* iBuffer;
+    size_t iSize;
+};
+
+// Waits for the next WebSocket message, giving its size.  Pings and
+// other control messages are dealt with on the way, as parseMessage()
+// does.  An empty message resumes the task with 0.  There's no timeout,
+// as messages can come at any time.
+class WebSocketMessageAwaiter : public HttpAwaiter
+{
+public:
+    WebSocketMessageAwaiter(WebSocketStream& aWebSocket)
+     : HttpAwaiter(aWebSocket, 0), iWebSocket(aWebSocket) {};
+
+protected:
+    virtual bool check()
+    {
+        if (!iWebSocket.nextMessage())
+        {
+            return false;
+        }
+        iResult = iWebSocket.available();
+        return true;
+    };
+
+    WebSocketStream& iWebSocket;
+};
+
+/** co_await these from an HttpTask, they give the same results as the
+  HttpStream call they're named after
+*/
+inline HttpStatusAwaiter awaitStatus(HttpStream& aHttp) { return HttpStatusAwaiter(aHttp); }
+inline HttpHeadersAwaiter awaitHeaders(HttpStream& aHttp) { return HttpHeadersAwaiter(aHttp); }
+inline HttpBodyAwaiter awaitBody(HttpStream& aHttp, uint8_t* aBuffer, size_t aSize)
+  { return HttpBodyAwaiter(aHttp, aBuffer, aSize); }
+inline WebSocketMessageAwaiter awaitMessage(WebSocketStream& aWebSocket)
+  { return WebSocketMessageAwaiter(aWebSocket); }
+
+#endif // HTTP_COROUTINES_SUPPORTED
+
+#endif
@@ -0,0 +1,171 @@
+// Class to send application/x-www-form-urlencoded request bodies
+// Released under Apache License, version 2.0
+
+#include "HttpForm.h"
+
+HttpForm::HttpForm()
+ : iFieldCount(0), iOutput(NULL), iCount(0), iError(HTTP_SUCCESS), iBlockLength(0)
+{
+}
+
+bool HttpForm::add(const char* aName, const char* aValue)
+{
+    if (iFieldCount == HTTP_FORM_MAX_FIELDS)
+    {
+        return false;
+    }
+
+    tField& field = iFields[iFieldCount++];
+
+    field.iName = aName;
+    field.iValue = aValue;
+    field.iNumber = 0;
+    return true;
+}
+
+bool HttpForm::add(const char* aName, long aValue)
+{
+    if (!add(aName, (const char*)NULL))
+    {
+        return false;
+    }
+    iFields[iFieldCount - 1].iNumber = aValue;
+    return true;
+}
+
+size_t HttpForm::contentLength()
+{
+    // Go through the motions without writing anything
+    Print* output = iOutput;
+
+    iOutput = NULL;
+    iCount = 0;
+    putBody();
+    iOutput = output;
+    return iCount;
+}
+
+int HttpForm::send(HttpStream& aHttp, const char* aURLPath, const char* aHttpMethod)
+{
+    aHttp.beginRequest();
+    int ret = aHttp.startRequest(aURLPath, aHttpMethod);
+
+    if (HTTP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    aHttp.sendHeader(HTTP_HEADER_CONTENT_TYPE, HTTP_CONTENT_TYPE_FORM);
+
+    aHttp.sendLengthHeader(HTTP_HEADER_CONTENT_LENGTH, contentLength());
+
+    aHttp.beginBody();
+    ret = writeTo(aHttp);
+    aHttp.endRequest();
+    return ret;
+}
+
+int HttpForm::writeTo(Print& aOutput)
+{
+    iOutput = &aOutput;
+    iCount = 0;
+    iError = HTTP_SUCCESS;
+    iBlockLength = 0;
+
+    putBody();
+    flush();
+
+    iOutput = NULL;
+    return iError;
+}
+
+void HttpForm::putBody()
+{
+    for (uint8_t i = 0; i < iFieldCount; i++)
+    {
+        const tField& field = iFields[i];
+
+        if (i > 0)
+        {
+            put('&');
+        }
+        put(field.iName, true);
+        put('=');
+
+        if (field.iValue)
+        {
+            put(field.iValue, true);
+        }
+        else
+        {
+            // Digits and a '-' don't need encoding.  Enough space for a
+            // 64-bit long
+            char digits[22];
+
+            snprintf(digits, sizeof(digits), "%ld", field.iNumber);
+            put(digits, false);
+        }
+    }
+}
+
+void HttpForm::put(const char* aText, bool aEncode)
+{
+    if (!iOutput)
+    {
+        iCount += aEncode ? URLEncoder.encodedLength(aText) : strlen(aText);
+    }
+    else if (aEncode)
+    {
+        // The encoder comes back through put() for each run it writes
+        BlockWriter writer(*this);
+
+        URLEncoder.encode(writer, aText);
+    }
+    else
+    {
+        put((const uint8_t*)aText, strlen(aText));
+    }
+}
+
+void HttpForm::put(const uint8_t* aData, size_t aLength)
+{
+    if (!iOutput)
+    {
+        iCount += aLength;
+        return;
+    }
+
+    while (aLength > 0)
+    {
+        if (iBlockLength == sizeof(iBlock))
+        {
+            flush();
+        }
+
+        size_t toCopy = sizeof(iBlock) - iBlockLength;
+
+        if (aLength < toCopy)
+        {
+            toCopy = aLength;
+        }
+        memcpy(iBlock + iBlockLength, aData, toCopy);
+        iBlockLength += toCopy;
+        aData += toCopy;
+        aLength -= toCopy;
+    }
+}
+
+void HttpForm::flush()
+{
+    if ((iBlockLength > 0) && (HTTP_SUCCESS == iError))
+    {
+        size_t written = iOutput->write(iBlock, iBlockLength);
+
+        iCount += written;
+        if (written != iBlockLength)
+        {
+            iError = HTTP_ERROR_WRITE_FAILED;
+        }
+    }
+    iBlockLength = 0;
+}
@@ -0,0 +1,131 @@
+// Class to send application/x-www-form-urlencoded request bodies
+// Released under Apache License, version 2.0
+
+#ifndef HttpForm_h
+#define HttpForm_h
+
+#include <Arduino.h>
+#include "HttpStream.h"
+#include "URLEncoder.h"
+
+// Most fields a single HttpForm can hold
+#ifndef HTTP_FORM_MAX_FIELDS
+#define HTTP_FORM_MAX_FIELDS 8
+#endif
+
+// Size of the block the encoded body is collected in before it's written
+#ifndef HTTP_FORM_BLOCK_SIZE
+#define HTTP_FORM_BLOCK_SIZE 64
+#endif
+
+#define HTTP_CONTENT_TYPE_FORM "application/x-www-form-urlencoded"
+
+// Builds a form body, "name=value&name2=value2", URL-encoding the names and
+// values as it writes them, so there are no temporary Strings.  It can also
+// be given to HttpStream::get() as a query string.  Its exact
+// length is worked out first, so it can be sent with a Content-Length.
+// Nothing is copied when the fields are added, so the names and values
+// must stay around until the body has been sent.
+class HttpForm
+{
+public:
+    HttpForm();
+
+    /** Add a field
+      @return false if there's no room for another one
+    */
+    bool add(const char* aName, const char* aValue);
+
+    /** Add a field whose value is a number
+      @return false if there's no room for another one
+    */
+    bool add(const char* aName, long aValue);
+    // So that add("count", 0) isn't ambiguous, as 0 could be a NULL aValue
+    bool add(const char* aName, int aValue) { return add(aName, (long)aValue); };
+
+    /** Forget all the fields, to start another form
+    */
+    void clear() { iFieldCount = 0; };
+
+    /** Return how many fields have been added
+    */
+    uint8_t count() { return iFieldCount; };
+
+    /** Return the length of the encoded body
+    */
+    size_t contentLength();
+
+    /** Send the body to aHttp as a request, with the Content-Type and
+      Content-Length headers that go with it.  Read the response as usual
+      afterwards.
+      @param aHttp        Where to send it
+      @param aURLPath     Url to request
+      @param aHttpMethod  Type of HTTP request to make
+      @return HTTP_SUCCESS if successful, else an error
+    */
+    int send(HttpStream& aHttp, const char* aURLPath, const char* aHttpMethod = HTTP_METHOD_POST);
+
+    /** Write the encoded body to aOutput, for when the request line and
+      headers have already been sent
+      @return HTTP_SUCCESS if successful, or HTTP_ERROR_WRITE_FAILED if
+      aOutput wouldn't take all of it
+    */
+    int writeTo(Print& aOutput);
+
+protected:
+    typedef struct {
+        const char* iName;
+        // The value, or NULL if it's iNumber
+        const char* iValue;
+        long iNumber;
+    } tField;
+
+    /* Send or count aText, URL-encoded if aEncode is true
+    */
+    void put(const char* aText, bool aEncode);
+
+    /* Send or count c
+    */
+    void put(char c) { put((const uint8_t*)&c, 1); };
+
+    /* Send or count aLength bytes of aData as they are
+    */
+    void put(const uint8_t* aData, size_t aLength);
+
+    /* Send whatever is waiting in iBlock
+    */
+    void flush();
+
+    /* Go through the whole body, sending it to iOutput or just counting it
+      if that's NULL
+    */
+    void putBody();
+
+    /* Print that adds whatever is written to it to the form's iBlock, so
+      URLEncoder can write into it
+    */
+    class BlockWriter : public Print
+    {
+    public:
+        BlockWriter(HttpForm& aForm) : iForm(aForm) {};
+        virtual size_t write(uint8_t c) { iForm.put((char)c); return 1; };
+        virtual size_t write(const uint8_t* aData, size_t aLength)
+          { iForm.put(aData, aLength); return aLength; };
+
+        HttpForm& iForm;
+    };
+
+    tField iFields[HTTP_FORM_MAX_FIELDS];
+    uint8_t iFieldCount;
+    // Where the body is being written, or NULL if it's just being measured
+    Print* iOutput;
+    // Bytes written or measured so far
+    size_t iCount;
+    // What went wrong, if anything
+    int iError;
+    // Encoded body waiting to be written
+    uint8_t iBlock[HTTP_FORM_BLOCK_SIZE];
+    size_t iBlockLength;
+};
+
+#endif
@@ -0,0 +1,533 @@
+// Class to pick values out of a JSON response body as it's read
+// Released under Apache License, version 2.0
+
+#include "HttpJsonReader.h"
+
+HttpJsonReader::HttpJsonReader(HttpStream& aHttp, char* aBuffer, size_t aBufferSize)
+ : iHttp(aHttp), iBlockPos(0), iBlockLength(0), iBodyEnded(false),
+   iValue(aBuffer), iValueSize(aBufferSize), iValueLength(0), iPathLength(0),
+   iDepth(0), iArrayMask(0), iExpectKey(false), iAfterValue(false),
+   iDone(false), iFailed(false)
+{
+    iValue[0] = '\0';
+    iPath[0] = '\0';
+}
+
+HttpJsonReader::tToken HttpJsonReader::next()
+{
+    if (iFailed)
+    {
+        return eTokenError;
+    }
+    iValueLength = 0;
+    iValue[0] = '\0';
+
+    int c = nextNonSpace();
+
+    if (iDone)
+    {
+        // There should be nothing after the top level value
+        if (c < 0)
+        {
+            return eTokenEnd;
+        }
+        iFailed = true;
+        return eTokenError;
+    }
+
+    if (iAfterValue)
+    {
+        // Only a ',' or the end of the object or array can come next
+        if (c == ',')
+        {
+            if (inArray())
+            {
+                iIndex[iDepth - 1]++;
+            }
+            else
+            {
+                iExpectKey = true;
+            }
+            iAfterValue = false;
+            c = nextNonSpace();
+
+            if ((c == '}') || (c == ']'))
+            {
+                // There has to be something after the ','
+                iFailed = true;
+                return eTokenError;
+            }
+        }
+        else if ((c != '}') && (c != ']'))
+        {
+            iFailed = true;
+            return eTokenError;
+        }
+    }
+
+    if ((c == '}') && (iExpectKey || iAfterValue))
+    {
+        return pop(false, eTokenEndObject);
+    }
+    else if (c == ']')
+    {
+        return pop(true, eTokenEndArray);
+    }
+    else if (iExpectKey)
+    {
+        // The name of the next member
+        if ((c != '"') || !readString())
+        {
+            iFailed = true;
+            return eTokenError;
+        }
+
+        truncatePath(iParentPathLength[iDepth - 1]);
+        if (iPathLength > 0)
+        {
+            appendPath(".");
+        }
+        if (valueTruncated())
+        {
+            // We don't know the whole key, so the path can't match anything
+            truncatePath(HTTP_JSON_PATH_SIZE);
+        }
+        else
+        {
+            appendPath(iValue, iValueLength);
+        }
+        iExpectKey = false;
+
+        if (nextNonSpace() != ':')
+        {
+            iFailed = true;
+            return eTokenError;
+        }
+        return eTokenKey;
+    }
+
+    // Anything else is the start of a value
+    startValue();
+
+    tToken token;
+
+    switch (c)
+    {
+    case '{':
+        return push(false, eTokenStartObject);
+    case '[':
+        return push(true, eTokenStartArray);
+    case '"':
+        token = readString() ? eTokenString : eTokenError;
+        break;
+    case 't':
+        token = readLiteral("true", eTokenTrue);
+        break;
+    case 'f':
+        token = readLiteral("false", eTokenFalse);
+        break;
+    case 'n':
+        token = readLiteral("null", eTokenNull);
+        break;
+    default:
+        if ((c == '-') || isdigit(c))
+        {
+            readNumber(c);
+            token = eTokenNumber;
+        }
+        else
+        {
+            // Including the body ending part way through
+            token = eTokenError;
+        }
+        break;
+    };
+
+    if (token == eTokenError)
+    {
+        iFailed = true;
+    }
+    else
+    {
+        iAfterValue = true;
+        iDone = (iDepth == 0);
+    }
+    return token;
+}
+
+HttpJsonReader::tToken HttpJsonReader::find(const char* aPattern)
+{
+    while (true)
+    {
+        tToken token = next();
+
+        switch (token)
+        {
+        case eTokenEnd:
+        case eTokenError:
+            return token;
+        case eTokenKey:
+        case eTokenEndObject:
+        case eTokenEndArray:
+            // These have the path of a value, but aren't its start
+            break;
+        default:
+            if (matches(aPattern))
+            {
+                return token;
+            }
+            break;
+        };
+    }
+}
+
+bool HttpJsonReader::matches(const char* aPattern)
+{
+    if (iPathLength >= sizeof(iPath))
+    {
+        // We don't know what the path is
+        return false;
+    }
+
+    const char* path = iPath;
+
+    while (*aPattern)
+    {
+        if (!strncmp(aPattern, "[*]", 3) && indexStartsAt(path - iPath))
+        {
+            // Any index will do
+            const char* end = strchr(path, ']');
+
+            if (!end)
+            {
+                return false;
+            }
+            aPattern += 3;
+            path = end + 1;
+        }
+        else if (*aPattern++ != *path++)
+        {
+            return false;
+        }
+    }
+    return (*path == '\0');
+}
+
+bool HttpJsonReader::indexStartsAt(size_t aOffset)
+{
+    // Only where an array's path ends, as a key can have a '[' in it too
+    for (uint8_t level = 0; level < iDepth; level++)
+    {
+        if ((iArrayMask & (1UL << level)) && (iParentPathLength[level] == aOffset))
+        {
+            return (iPath[aOffset] == '[');
+        }
+    }
+    return false;
+}
+
+int HttpJsonReader::peekChar()
+{
+    if (iBlockPos == iBlockLength)
+    {
+        if (iBodyEnded)
+        {
+            return -1;
+        }
+
+        int ret = HTTP_SUCCESS;
+
+        if (!iHttp.endOfHeadersReached())
+        {
+            ret = iHttp.skipResponseHeaders();
+        }
+
+        if (HTTP_SUCCESS == ret)
+        {
+            // Take whatever has already arrived, or wait for the next byte
+            ret = iHttp.read(iBlock, sizeof(iBlock));
+            if (ret < 0)
+            {
+                ret = iHttp.readBytes(iBlock, 1);
+            }
+        }
+
+        if (ret <= 0)
+        {
+            // Either it's the end of the body or it has stopped arriving
+            iBodyEnded = true;
+            return -1;
+        }
+        iBlockPos = 0;
+        iBlockLength = ret;
+    }
+    return iBlock[iBlockPos];
+}
+
+int HttpJsonReader::nextChar()
+{
+    int c = peekChar();
+
+    if (c >= 0)
+    {
+        iBlockPos++;
+    }
+    return c;
+}
+
+int HttpJsonReader::nextNonSpace()
+{
+    int c;
+
+    do
+    {
+        c = nextChar();
+    } while ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'));
+    return c;
+}
+
+void HttpJsonReader::startValue()
+{
+    if (inArray())
+    {
+        // Its path is the array's, with the index added
+        char index[8];
+        char* start = index + sizeof(index);
+        uint16_t value = iIndex[iDepth - 1];
+
+        *--start = ']';
+        do
+        {
+            *--start = '0' + (value % 10);
+            value /= 10;
+        } while (value);
+        *--start = '[';
+
+        truncatePath(iParentPathLength[iDepth - 1]);
+        appendPath(start, index + sizeof(index) - start);
+    }
+    // else the key has already given it its path
+}
+
+void HttpJsonReader::appendPath(const char* aText, size_t aLength)
+{
+    for (size_t i = 0; i < aLength; i++)
+    {
+        if (iPathLength < sizeof(iPath) - 1)
+        {
+            iPath[iPathLength] = aText[i];
+        }
+        // Keep counting past the end of iPath, so we know it didn't fit
+        iPathLength++;
+    }
+    iPath[(iPathLength < sizeof(iPath)) ? iPathLength : sizeof(iPath) - 1] = '\0';
+}
+
+void HttpJsonReader::truncatePath(size_t aLength)
+{
+    iPathLength = aLength;
+    iPath[(iPathLength < sizeof(iPath)) ? iPathLength : sizeof(iPath) - 1] = '\0';
+}
+
+void HttpJsonReader::appendValue(char c)
+{
+    if (iValueLength < iValueSize - 1)
+    {
+        iValue[iValueLength] = c;
+        iValue[iValueLength + 1] = '\0';
+    }
+    iValueLength++;
+}
+
+bool HttpJsonReader::readString()
+{
+    while (true)
+    {
+        int c = nextChar();
+
+        if (c == '"')
+        {
+            return true;
+        }
+        else if (c < 0x20)
+        {
+            // The end of the body, or a control character that should have
+            // been escaped
+            return false;
+        }
+        else if (c != '\\')
+        {
+            appendValue(c);
+            continue;
+        }
+
+        c = nextChar();
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            appendValue(c);
+            break;
+        case 'b':
+            appendValue('\b');
+            break;
+        case 'f':
+            appendValue('\f');
+            break;
+        case 'n':
+            appendValue('\n');
+            break;
+        case 'r':
+            appendValue('\r');
+            break;
+        case 't':
+            appendValue('\t');
+            break;
+        case 'u':
+        {
+            long codePoint = readHexEscape();
+
+            if ((codePoint >= 0xd800) && (codePoint < 0xdc00))
+            {
+                // The first half of a surrogate pair, the second half should
+                // follow straight after
+                long low = -1;
+
+                if ((nextChar() == '\\') && (nextChar() == 'u'))
+                {
+                    low = readHexEscape();
+                }
+                if ((low < 0xdc00) || (low > 0xdfff))
+                {
+                    return false;
+                }
+                codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+            }
+            else if ((codePoint < 0) || ((codePoint >= 0xdc00) && (codePoint <= 0xdfff)))
+            {
+                return false;
+            }
+            appendCodePoint(codePoint);
+            break;
+        }
+        default:
+            return false;
+        };
+    }
+}
+
+long HttpJsonReader::readHexEscape()
+{
+    long value = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        int c = nextChar();
+
+        if (!isxdigit(c))
+        {
+            return -1;
+        }
+        value = (value << 4) | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+    }
+    return value;
+}
+
+void HttpJsonReader::appendCodePoint(unsigned long aCodePoint)
+{
+    if (aCodePoint < 0x80)
+    {
+        appendValue(aCodePoint);
+    }
+    else if (aCodePoint < 0x800)
+    {
+        appendValue(0xc0 | (aCodePoint >> 6));
+        appendValue(0x80 | (aCodePoint & 0x3f));
+    }
+    else if (aCodePoint < 0x10000)
+    {
+        appendValue(0xe0 | (aCodePoint >> 12));
+        appendValue(0x80 | ((aCodePoint >> 6) & 0x3f));
+        appendValue(0x80 | (aCodePoint & 0x3f));
+    }
+    else
+    {
+        appendValue(0xf0 | (aCodePoint >> 18));
+        appendValue(0x80 | ((aCodePoint >> 12) & 0x3f));
+        appendValue(0x80 | ((aCodePoint >> 6) & 0x3f));
+        appendValue(0x80 | (aCodePoint & 0x3f));
+    }
+}
+
+void HttpJsonReader::readNumber(char c)
+{
+    appendValue(c);
+
+    // Leave whatever follows it for next time
+    while (true)
+    {
+        c = peekChar();
+
+        if (!isdigit(c) && (c != '.') && (c != 'e') && (c != 'E') && (c != '+') && (c != '-'))
+        {
+            return;
+        }
+        appendValue(c);
+        iBlockPos++;
+    }
+}
+
+HttpJsonReader::tToken HttpJsonReader::readLiteral(const char* aLiteral, tToken aToken)
+{
+    while (*++aLiteral)
+    {
+        if (nextChar() != *aLiteral)
+        {
+            return eTokenError;
+        }
+    }
+    return aToken;
+}
+
+HttpJsonReader::tToken HttpJsonReader::push(bool aArray, tToken aToken)
+{
+    if (iDepth == HTTP_JSON_MAX_DEPTH)
+    {
+        iFailed = true;
+        return eTokenError;
+    }
+
+    if (aArray)
+    {
+        iArrayMask |= (1UL << iDepth);
+    }
+    else
+    {
+        iArrayMask &= ~(1UL << iDepth);
+    }
+    iParentPathLength[iDepth] = iPathLength;
+    iIndex[iDepth] = 0;
+    iDepth++;
+
+    iExpectKey = !aArray;
+    iAfterValue = false;
+    return aToken;
+}
+
+HttpJsonReader::tToken HttpJsonReader::pop(bool aArray, tToken aToken)
+{
+    if ((iDepth == 0) || (inArray() != aArray))
+    {
+        iFailed = true;
+        return eTokenError;
+    }
+
+    iDepth--;
+    // Back to the path of the object or array itself
+    truncatePath(iParentPathLength[iDepth]);
+    iExpectKey = false;
+    iAfterValue = true;
+    iDone = (iDepth == 0);
+    return aToken;
+}
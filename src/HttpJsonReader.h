@@ -0,0 +1,221 @@
+// Class to pick values out of a JSON response body as it's read
+// Released under Apache License, version 2.0
+
+#ifndef HttpJsonReader_h
+#define HttpJsonReader_h
+
+#include <Arduino.h>
+#include "HttpStream.h"
+
+// Deepest nesting of objects and arrays that can be read
+#ifndef HTTP_JSON_MAX_DEPTH
+#define HTTP_JSON_MAX_DEPTH 16
+#endif
+#if HTTP_JSON_MAX_DEPTH > 32
+#error "HTTP_JSON_MAX_DEPTH can't be more than 32"
+#endif
+
+// Space for the path to the current value, e.g. "devices[3].name"
+#ifndef HTTP_JSON_PATH_SIZE
+#define HTTP_JSON_PATH_SIZE 64
+#endif
+
+// Size of the blocks the body is read in
+#ifndef HTTP_JSON_BLOCK_SIZE
+#define HTTP_JSON_BLOCK_SIZE 64
+#endif
+#if (HTTP_JSON_BLOCK_SIZE < 1) || (HTTP_JSON_BLOCK_SIZE > 255)
+#error "HTTP_JSON_BLOCK_SIZE must be between 1 and 255"
+#endif
+
+// Reads a JSON response body a token at a time, straight from the
+// HttpStream, so the body never has to be held in memory.  Strings and
+// numbers are collected in a buffer you supply, so a value longer than that
+// is truncated, but the rest of the body can still be read.  It doesn't
+// matter how the body arrives, a byte at a time or in chunks.
+//
+// Either call next() and look at each token, or call find() to skip to the
+// values you're interested in by their path.
+class HttpJsonReader
+{
+public:
+    typedef enum {
+        // The body is well formed JSON that has all been read
+        eTokenEnd,
+        // The body isn't JSON we can read, or it stopped arriving
+        eTokenError,
+        eTokenStartObject,
+        eTokenEndObject,
+        eTokenStartArray,
+        eTokenEndArray,
+        // The name of the next member of an object, in value()
+        eTokenKey,
+        // The value is in value()
+        eTokenString,
+        eTokenNumber,
+        eTokenTrue,
+        eTokenFalse,
+        eTokenNull
+    } tToken;
+
+    /** Read the body of the response on aHttp, which should be called after
+      responseStatusCode().  The headers are skipped if need be
+      @param aHttp        Where to read the body from
+      @param aBuffer      Space for strings, numbers and keys
+      @param aBufferSize  Size of aBuffer, including space for a '\0'
+    */
+    HttpJsonReader(HttpStream& aHttp, char* aBuffer, size_t aBufferSize);
+
+    /** Read the next token, waiting up to the stream's timeout for more of
+      the body to arrive if need be
+    */
+    tToken next();
+
+    /** Read tokens until reaching a value whose path matches aPattern.  In
+      aPattern "[*]" matches any array index, e.g. "devices[*].name"
+      @return The token for the start of the value, or eTokenEnd or
+      eTokenError if there are no more matches
+    */
+    tToken find(const char* aPattern);
+
+    /** Test whether the path of the current token matches aPattern, as for
+      find()
+    */
+    bool matches(const char* aPattern);
+
+    /** Return the path of the current token, e.g. "devices[3].name".  For a
+      key or a value it's the path of the value, for the start or end of an
+      object or array the path of the object or array.  The top level value
+      has the path "".  If the path is longer than HTTP_JSON_PATH_SIZE, or
+      has a key that didn't fit in the buffer, it's incomplete and won't
+      match anything
+    */
+    const char* path() { return iPath; };
+
+    /** Return the key, string or number read by the last call to next(),
+      or "" for other tokens
+    */
+    const char* value() { return iValue; };
+
+    /** Test whether value() was too long for the buffer, so only the start
+      of it is there
+    */
+    bool valueTruncated() { return iValueLength >= iValueSize; };
+
+    /** Return the value as a number
+    */
+    long valueAsLong() { return strtol(iValue, NULL, 10); };
+    double valueAsDouble() { return strtod(iValue, NULL); };
+
+    /** Return how deeply nested in objects and arrays the current token is
+    */
+    uint8_t depth() { return iDepth; };
+
+protected:
+    /* Return the next character of the body without using it up, or -1 if
+      there are no more
+    */
+    int peekChar();
+
+    /* Return the next character of the body, or -1 if there are no more
+    */
+    int nextChar();
+
+    /* Skip any whitespace, and return the first character after it
+    */
+    int nextNonSpace();
+
+    /* Set iPath to the path of a value that's just starting
+    */
+    void startValue();
+
+    /* Add aText, or aLength bytes of it, to the end of iPath
+    */
+    void appendPath(const char* aText, size_t aLength);
+    void appendPath(const char* aText) { appendPath(aText, strlen(aText)); };
+
+    /* Cut iPath back to aLength
+    */
+    void truncatePath(size_t aLength);
+
+    /* Add c to iValue
+    */
+    void appendValue(char c);
+
+    /* Read the rest of a string into iValue
+      @return false if it isn't a valid string
+    */
+    bool readString();
+
+    /* Read the four hex digits of a \u escape
+      @return The code unit, or -1 if they aren't valid
+    */
+    long readHexEscape();
+
+    /* Add the UTF-8 encoding of aCodePoint to iValue
+    */
+    void appendCodePoint(unsigned long aCodePoint);
+
+    /* Read the rest of a number into iValue, starting with c
+    */
+    void readNumber(char c);
+
+    /* Check the rest of the literal aLiteral, whose first letter has been
+      read
+      @return aToken if it matches, else eTokenError
+    */
+    tToken readLiteral(const char* aLiteral, tToken aToken);
+
+    /* Open an object or array
+      @return aToken if it's successful, or eTokenError if it's too deep
+    */
+    tToken push(bool aArray, tToken aToken);
+
+    /* Close an object or array
+      @return aToken if it's the one that's open, else eTokenError
+    */
+    tToken pop(bool aArray, tToken aToken);
+
+    /* Return whether an array index, which we put in the path, starts at
+      aOffset in iPath
+    */
+    bool indexStartsAt(size_t aOffset);
+
+    /* Return whether the innermost object or array is an array
+    */
+    bool inArray() { return iDepth && (iArrayMask & (1UL << (iDepth - 1))); };
+
+    HttpStream& iHttp;
+    // The part of the body read but not used yet
+    uint8_t iBlock[HTTP_JSON_BLOCK_SIZE];
+    uint8_t iBlockPos;
+    uint8_t iBlockLength;
+    // Whether the end of the body has been reached
+    bool iBodyEnded;
+    // Key, string or number being read
+    char* iValue;
+    size_t iValueSize;
+    size_t iValueLength;
+    // Path of the current token, and how long it would be if it all fitted
+    char iPath[HTTP_JSON_PATH_SIZE];
+    size_t iPathLength;
+    // How many objects and arrays we're in, and one bit for each level
+    // which is set if it's an array
+    uint8_t iDepth;
+    uint32_t iArrayMask;
+    // Length of the path of each object and array we're in, and for arrays
+    // the index of the current element
+    size_t iParentPathLength[HTTP_JSON_MAX_DEPTH];
+    uint16_t iIndex[HTTP_JSON_MAX_DEPTH];
+    // Whether we're in an object waiting for the next key
+    bool iExpectKey;
+    // Whether we've finished a value and are waiting for a ',' or the end
+    // of the object or array
+    bool iAfterValue;
+    // Whether the top level value is complete
+    bool iDone;
+    // Set once anything has gone wrong, as there's no carrying on after that
+    bool iFailed;
+};
+
+#endif
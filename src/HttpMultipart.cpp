@@ -0,0 +1,236 @@
+// Class to send multipart/form-data request bodies, e.g. for file uploads
+// Released under Apache License, version 2.0
+
+#include "HttpMultipart.h"
+
+HttpMultipart::HttpMultipart()
+ : iPartCount(0), iOutput(NULL), iCount(0), iError(HTTP_SUCCESS), iBlockLength(0)
+{
+    // Random enough that it won't turn up in the data by accident
+    static const char hexDigits[] = "0123456789abcdef";
+    char* end = iBoundary + strlen(strcpy(iBoundary, "ArduinoHttpStream"));
+
+    for (int i = 0; i < 16; i++)
+    {
+        *end++ = hexDigits[random(0, 16)];
+    }
+    *end = '\0';
+}
+
+bool HttpMultipart::addField(const char* aName, const char* aValue)
+{
+    return addPart(aName, NULL, NULL, (const uint8_t*)aValue, NULL, strlen(aValue));
+}
+
+bool HttpMultipart::addData(const char* aName, const char* aFileName, const char* aContentType,
+                            const uint8_t* aData, size_t aLength)
+{
+    return addPart(aName, aFileName, aContentType, aData, NULL, aLength);
+}
+
+bool HttpMultipart::addStream(const char* aName, const char* aFileName, const char* aContentType,
+                              Stream& aSource, tHttpLength aLength)
+{
+    return addPart(aName, aFileName, aContentType, NULL, &aSource, aLength);
+}
+
+bool HttpMultipart::addPart(const char* aName, const char* aFileName, const char* aContentType,
+                            const uint8_t* aData, Stream* aSource, tHttpLength aLength)
+{
+    if (iPartCount == HTTP_MULTIPART_MAX_PARTS)
+    {
+        return false;
+    }
+
+    tPart& part = iParts[iPartCount++];
+
+    part.iName = aName;
+    part.iFileName = aFileName;
+    part.iContentType = aContentType;
+    part.iData = aData;
+    part.iSource = aSource;
+    part.iLength = aLength;
+    return true;
+}
+
+tHttpLength HttpMultipart::contentLength()
+{
+    // Go through the motions without writing anything
+    Print* output = iOutput;
+
+    iOutput = NULL;
+    iCount = 0;
+    for (uint8_t i = 0; i < iPartCount; i++)
+    {
+        putBoundary(&iParts[i]);
+        iCount += iParts[i].iLength;
+        put("\r\n");
+    }
+    putBoundary(NULL);
+    iOutput = output;
+    return iCount;
+}
+
+int HttpMultipart::send(HttpStream& aHttp, const char* aURLPath, const char* aHttpMethod)
+{
+    aHttp.beginRequest();
+    int ret = aHttp.startRequest(aURLPath, aHttpMethod);
+
+    if (HTTP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    char contentType[sizeof("multipart/form-data; boundary=") + sizeof(iBoundary)];
+
+    strcpy(contentType, "multipart/form-data; boundary=");
+    strcat(contentType, iBoundary);
+    aHttp.sendHeader(HTTP_HEADER_CONTENT_TYPE, contentType);
+
+    aHttp.sendLengthHeader(HTTP_HEADER_CONTENT_LENGTH, contentLength());
+
+    aHttp.beginBody();
+    ret = writeTo(aHttp);
+    aHttp.endRequest();
+    return ret;
+}
+
+int HttpMultipart::writeTo(Print& aOutput)
+{
+    iOutput = &aOutput;
+    iCount = 0;
+    iError = HTTP_SUCCESS;
+    iBlockLength = 0;
+
+    for (uint8_t i = 0; (i < iPartCount) && (HTTP_SUCCESS == iError); i++)
+    {
+        const tPart& part = iParts[i];
+
+        putBoundary(&part);
+        if (part.iSource)
+        {
+            copyStream(part);
+        }
+        else
+        {
+            put(part.iData, part.iLength);
+        }
+        put("\r\n");
+    }
+    putBoundary(NULL);
+    flush();
+
+    iOutput = NULL;
+    return iError;
+}
+
+void HttpMultipart::putBoundary(const tPart* aPart)
+{
+    put("--");
+    put(iBoundary);
+    if (!aPart)
+    {
+        // That's the end of the body
+        put("--\r\n");
+        return;
+    }
+
+    put("\r\nContent-Disposition: form-data; name=\"");
+    put(aPart->iName);
+    put("\"");
+    if (aPart->iFileName)
+    {
+        put("; filename=\"");
+        put(aPart->iFileName);
+        put("\"");
+    }
+    put("\r\n");
+    if (aPart->iContentType)
+    {
+        put(HTTP_HEADER_CONTENT_TYPE ": ");
+        put(aPart->iContentType);
+        put("\r\n");
+    }
+    put("\r\n");
+}
+
+void HttpMultipart::put(const uint8_t* aData, size_t aLength)
+{
+    if (!iOutput)
+    {
+        iCount += aLength;
+        return;
+    }
+
+    if (aLength > sizeof(iBlock) - iBlockLength)
+    {
+        flush();
+        if (aLength >= sizeof(iBlock))
+        {
+            // No point copying it, it wouldn't fit anyway
+            if (HTTP_SUCCESS == iError)
+            {
+                size_t written = iOutput->write(aData, aLength);
+
+                iCount += written;
+                if (written != aLength)
+                {
+                    iError = HTTP_ERROR_WRITE_FAILED;
+                }
+            }
+            return;
+        }
+    }
+    memcpy(iBlock + iBlockLength, aData, aLength);
+    iBlockLength += aLength;
+}
+
+void HttpMultipart::flush()
+{
+    if ((iBlockLength > 0) && (HTTP_SUCCESS == iError))
+    {
+        size_t written = iOutput->write(iBlock, iBlockLength);
+
+        iCount += written;
+        if (written != iBlockLength)
+        {
+            iError = HTTP_ERROR_WRITE_FAILED;
+        }
+    }
+    iBlockLength = 0;
+}
+
+void HttpMultipart::copyStream(const tPart& aPart)
+{
+    tHttpLength remaining = aPart.iLength;
+
+    // Read straight in after the part's headers, so they go out together
+    while ((remaining > 0) && (HTTP_SUCCESS == iError))
+    {
+        if (iBlockLength == sizeof(iBlock))
+        {
+            // Full, possibly with just the headers
+            flush();
+            continue;
+        }
+
+        size_t toRead = sizeof(iBlock) - iBlockLength;
+
+        if (remaining < (tHttpLength)toRead)
+        {
+            toRead = (size_t)remaining;
+        }
+
+        size_t count = aPart.iSource->readBytes(iBlock + iBlockLength, toRead);
+
+        if (count == 0)
+        {
+            // It ran out before the length we were promised, so the
+            // Content-Length we sent is wrong
+            iError = HTTP_ERROR_TIMED_OUT;
+            return;
+        }
+        iBlockLength += count;
+        remaining -= count;
+    }
+}
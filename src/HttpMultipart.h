@@ -0,0 +1,141 @@
+// Class to send multipart/form-data request bodies, e.g. for file uploads
+// Released under Apache License, version 2.0
+
+#ifndef HttpMultipart_h
+#define HttpMultipart_h
+
+#include <Arduino.h>
+#include "HttpStream.h"
+
+// Most parts a single HttpMultipart can hold
+#ifndef HTTP_MULTIPART_MAX_PARTS
+#define HTTP_MULTIPART_MAX_PARTS 8
+#endif
+
+// Size of the block the boundaries and part headers are collected in, and
+// that data from a Stream is copied through
+#ifndef HTTP_MULTIPART_BLOCK_SIZE
+#define HTTP_MULTIPART_BLOCK_SIZE 128
+#endif
+
+// Builds a multipart/form-data body from form fields, buffers and Streams,
+// working out its exact length first so that it can be sent with a
+// Content-Length rather than held in memory.  Nothing is copied when the
+// parts are added, so the names, values and data must stay around until the
+// body has been sent.  Names and file names are sent as they are, so they
+// mustn't contain '"' or line breaks.
+class HttpMultipart
+{
+public:
+    /** Start an empty body, with a random boundary between the parts
+    */
+    HttpMultipart();
+
+    /** Add a form field
+      @param aName   Name of the field
+      @param aValue  Its value
+      @return false if there's no room for another part
+    */
+    bool addField(const char* aName, const char* aValue);
+
+    /** Add a part whose contents are in memory
+      @param aName         Name of the field
+      @param aFileName     File name to give it, or NULL for none
+      @param aContentType  Content type of the data, or NULL for none
+      @param aData         The data
+      @param aLength       Length of aData
+      @return false if there's no room for another part
+    */
+    bool addData(const char* aName, const char* aFileName, const char* aContentType,
+                 const uint8_t* aData, size_t aLength);
+
+    /** Add a part whose contents are read from aSource as the body is sent,
+      e.g. a file on an SD card
+      @param aName         Name of the field
+      @param aFileName     File name to give it, or NULL for none
+      @param aContentType  Content type of the data, or NULL for none
+      @param aSource       Where to read the data from
+      @param aLength       Exactly how many bytes will be read from aSource
+      @return false if there's no room for another part
+    */
+    bool addStream(const char* aName, const char* aFileName, const char* aContentType,
+                   Stream& aSource, tHttpLength aLength);
+
+    /** Return the length of the whole body, boundaries and all
+    */
+    tHttpLength contentLength();
+
+    /** Return the boundary between the parts, for the Content-Type header
+      if you're sending the request yourself
+    */
+    const char* boundary() { return iBoundary; };
+
+    /** Send the body to aHttp as a request, with the Content-Type and
+      Content-Length headers that go with it.  Read the response as usual
+      afterwards.
+      @param aHttp        Where to send it
+      @param aURLPath     Url to request
+      @param aHttpMethod  Type of HTTP request to make
+      @return HTTP_SUCCESS if successful, else an error
+    */
+    int send(HttpStream& aHttp, const char* aURLPath, const char* aHttpMethod = HTTP_METHOD_POST);
+
+    /** Write the body to aOutput, for when the request line and headers
+      have already been sent
+      @return HTTP_SUCCESS if successful, HTTP_ERROR_TIMED_OUT if a Stream
+      part ran out before its length, or HTTP_ERROR_WRITE_FAILED if aOutput
+      wouldn't take all of it
+    */
+    int writeTo(Print& aOutput);
+
+protected:
+    typedef struct {
+        const char* iName;
+        const char* iFileName;
+        const char* iContentType;
+        // Where the contents come from, one or the other
+        const uint8_t* iData;
+        Stream* iSource;
+        tHttpLength iLength;
+    } tPart;
+
+    /* Add a part
+      @return false if there's no room for it
+    */
+    bool addPart(const char* aName, const char* aFileName, const char* aContentType,
+                 const uint8_t* aData, Stream* aSource, tHttpLength aLength);
+
+    /* Send or count the boundary and headers before a part, or the final
+      boundary if aPart is NULL
+    */
+    void putBoundary(const tPart* aPart);
+
+    /* Send aLength bytes of aData to iOutput through iBlock, or just count
+      them if iOutput is NULL
+    */
+    void put(const uint8_t* aData, size_t aLength);
+    void put(const char* aText) { put((const uint8_t*)aText, strlen(aText)); };
+
+    /* Send whatever is waiting in iBlock
+    */
+    void flush();
+
+    /* Copy a part's data from its Stream to iOutput
+    */
+    void copyStream(const tPart& aPart);
+
+    char iBoundary[40];
+    tPart iParts[HTTP_MULTIPART_MAX_PARTS];
+    uint8_t iPartCount;
+    // Where the body is being written, or NULL if it's just being measured
+    Print* iOutput;
+    // Bytes written or measured so far
+    tHttpLength iCount;
+    // What went wrong, if anything
+    int iError;
+    // Boundaries and part headers waiting to be written
+    uint8_t iBlock[HTTP_MULTIPART_BLOCK_SIZE];
+    size_t iBlockLength;
+};
+
+#endif
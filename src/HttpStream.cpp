@@ -3,54 +3,152 @@
 // Released under Apache License, version 2.0
 
 #include "HttpStream.h"
+#include "HttpForm.h"
+#include <limits.h>
 #include "b64.h"
 
 // Initialize constants
-const char* HttpStream::kContentLengthPrefix = HTTP_HEADER_CONTENT_LENGTH ": ";
-const char* HttpStream::kTransferEncodingChunked = HTTP_HEADER_TRANSFER_ENCODING ": " HTTP_HEADER_VALUE_CHUNKED;
+const char HttpStream::kHexDigits[] = "0123456789abcdef";
+
+// Value of each character as a hex digit, or 0xff if it isn't one.  Kept in
+// flash, so use hexValue() to read it
+#define HEX_NONE 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, \
+                 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+const uint8_t HttpStream::kHexValues[256] PROGMEM = {
+    HEX_NONE, HEX_NONE, HEX_NONE,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 10, 11, 12, 13, 14, 15, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    HEX_NONE,
+    0xff, 10, 11, 12, 13, 14, 15, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    HEX_NONE, HEX_NONE, HEX_NONE, HEX_NONE, HEX_NONE, HEX_NONE, HEX_NONE, HEX_NONE, HEX_NONE
+};
+#undef HEX_NONE
+const char* HttpStream::kConnectionClose = "close";
+
+// Clock for the HttpStreams which haven't been given one of their own
+static HttpClock defaultClock;
+const char* HttpStream::kStatusPrefix = "HTTP/*.* ";
+const char* const HttpStream::kKnownHeaders[] = {
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_CONTENT_ENCODING,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_ETAG,
+    HTTP_HEADER_LOCATION,
+    HTTP_HEADER_LAST_MODIFIED,
+    HTTP_HEADER_CONTENT_RANGE
+};
 
 HttpStream::HttpStream(Stream& aStream)
- : iStream(&aStream) {
+ : iStream(&aStream), iClock(&defaultClock), iState(eIdle), iDeflater(NULL),
+   iInflater(NULL), iCache(NULL), iCacheState(eCacheUnused), iPipelining(false),
+   iProgressCallback(NULL), iProgressContext(NULL) {
+#ifdef HTTP_STATE_TRACE
+  iStateTraceCallback = NULL;
+#endif
+  clearCapturedHeaders();
   resetState();
 }
 
 
 void HttpStream::resetState()
 {
-  iState = eIdle;
+  setState(eIdle);
+  iTxBufferLength = 0;
+  iTxChunked = false;
+  iTxDeflating = false;
+  iQueuedResponses = 0;
+  memset(&iStats, 0, sizeof(iStats));
+  if (iCacheState == eCacheStoring)
+  {
+    // We never got to the end of the body
+    endCaching(false);
+  }
+  iCacheState = eCacheUnused;
+  resetResponseState();
+  iHttpResponseTimeout = kHttpResponseTimeout;
+}
+
+void HttpStream::resetResponseState()
+{
   iStatusCode = 0;
+  iStatusPtr = kStatusPrefix;
   iContentLength = kNoContentLengthHeader;
   iBodyLengthConsumed = 0;
-  iContentLengthPtr = kContentLengthPrefix;
-  iTransferEncodingChunkedPtr = kTransferEncodingChunked;
+  iInvalidLength = false;
   iIsChunked = false;
+  iConnectionClose = false;
+  iContentRangeStart = -1;
+  iContentRangeTotal = -1;
+  iContentCoding = eCodingIdentity;
+  iContentCodingLength = 0;
+  iDecoding = false;
   iChunkLength = 0;
-  iHttpResponseTimeout = kHttpResponseTimeout;
+  // Make sure we don't leave captured values from the last response lying
+  // around
+  for (int i = 0; i < iHeaderCount; i++)
+  {
+    if (iHeaderValues[i])
+    {
+      iHeaderValues[i][0] = '\0';
+    }
+  }
 }
 
 void HttpStream::beginRequest()
 {
-  iState = eRequestStarted;
+  if (endOfHeadersReached() && (iQueuedResponses == 0))
+  {
+    finishResponse();
+  }
+
+  if (iPipelining && (iState == eRequestSent))
+  {
+    // The response to this one will follow the one we're already expecting
+    iQueuedResponses++;
+  }
+  setState(eRequestStarted);
 }
 
 int HttpStream::startRequest(const char* aURLPath, const char* aHttpMethod, 
                                 const char* aContentType, int aContentLength, const byte aBody[])
 {
-    if (iState == eReadingBody || iState == eReadingChunkLength || iState == eReadingBodyChunk)
-    {
-        flushStreamRx();
+    return startRequest(aURLPath, (HttpForm*)NULL, aHttpMethod, aContentType, aContentLength, aBody);
+}
+
+int HttpStream::startRequest(const char* aURLPath, HttpForm& aQuery, const char* aHttpMethod)
+{
+    return startRequest(aURLPath, &aQuery, aHttpMethod, NULL, -1, NULL);
+}
 
-        resetState();
+int HttpStream::startRequest(const char* aURLPath, HttpForm* aQuery, const char* aHttpMethod,
+                             const char* aContentType, int aContentLength, const byte aBody[])
+{
+    if (endOfHeadersReached())
+    {
+        if (iQueuedResponses > 0)
+        {
+            // Reading the responses has already started, it's too late to
+            // add to the pipeline
+            return HTTP_ERROR_API;
+        }
+        finishResponse();
     }
 
     tHttpState initialState = iState;
 
-    if ((eIdle != iState) && (eRequestStarted != iState))
+    if (iPipelining && (eRequestSent == iState))
+    {
+        // The response to this one will follow the one we're already
+        // expecting
+        iQueuedResponses++;
+    }
+    else if ((eIdle != iState) && (eRequestStarted != iState))
     {
         return HTTP_ERROR_API;
     }
 
-    int ret = sendInitialHeaders(aURLPath, aHttpMethod);
+    int ret = sendInitialHeaders(aURLPath, aHttpMethod, aQuery);
 
     if (HTTP_SUCCESS == ret)
     {
@@ -59,21 +157,53 @@ int HttpStream::startRequest(const char* aURLPath, const char* aHttpMethod,
             sendHeader(HTTP_HEADER_CONTENT_TYPE, aContentType);
         }
 
-        if (aContentLength > 0)
+        bool hasBody = (aBody && aContentLength > 0);
+        bool compressBody = hasBody && iDeflater;
+
+        if (compressBody)
+        {
+            sendHeader(HTTP_HEADER_CONTENT_ENCODING, "deflate");
+            sendLengthHeader(HTTP_HEADER_CONTENT_LENGTH,
+                             iDeflater->compressedLength(aBody, aContentLength));
+        }
+        else if (aContentLength > 0)
         {
             sendHeader(HTTP_HEADER_CONTENT_LENGTH, aContentLength);
         }
 
-        bool hasBody = (aBody && aContentLength > 0);
+        // The cache only goes by the path, so it can't tell different
+        // queries apart
+        bool hasQuery = aQuery && (aQuery->count() > 0);
+
+        if (iCache && (iQueuedResponses == 0) && !hasQuery && !strcmp(aHttpMethod, HTTP_METHOD_GET))
+        {
+            // Only ask for it if it's changed since the one we've got
+            iCacheState = iCache->find(aURLPath) ? eCacheHit : eCacheMiss;
+            if ((iCacheState == eCacheHit) && iCache->etag()[0])
+            {
+                sendHeader(HTTP_HEADER_IF_NONE_MATCH, iCache->etag());
+            }
+            if ((iCacheState == eCacheHit) && iCache->lastModified()[0])
+            {
+                sendHeader(HTTP_HEADER_IF_MODIFIED_SINCE, iCache->lastModified());
+            }
+        }
 
-        if (initialState == eIdle || hasBody)
+        if (initialState != eRequestStarted || hasBody)
         {
             // This was a simple version of the API, so terminate the headers now
             finishHeaders();
         }
         // else we'll call it in endRequest or in the first call to print, etc.
 
-        if (hasBody)
+        if (compressBody)
+        {
+            // The compressed data comes back through write() to be sent
+            iDeflater->begin(*this);
+            iDeflater->write(aBody, aContentLength);
+            iDeflater->end();
+        }
+        else if (hasBody)
         {
                 write(aBody, aContentLength);
         }
@@ -82,46 +212,78 @@ int HttpStream::startRequest(const char* aURLPath, const char* aHttpMethod,
     return ret;
 }
 
-int HttpStream::sendInitialHeaders(const char* aURLPath, const char* aHttpMethod)
+int HttpStream::sendInitialHeaders(const char* aURLPath, const char* aHttpMethod, HttpForm* aQuery)
 {
 #ifdef LOGGING
     Serial.println("Connected");
 #endif
+    if (iStats.requestBytes == 0)
+    {
+        // This is the first request since the stats were reset, rather than
+        // one pipelined after it
+        iStats.requestStart = iClock->now();
+    }
+
     // Send the HTTP command, i.e. "GET /somepath/ HTTP/1.0"
-    iStream->print(aHttpMethod);
-    iStream->print(" ");
+    bufferHeader(aHttpMethod);
+    bufferHeader(" ");
 
-    iStream->print(aURLPath);
-    iStream->println(" HTTP/1.1");
+    bufferHeader(aURLPath);
+    if (aQuery && (aQuery->count() > 0))
+    {
+        // It's encoded as it goes into iTxBuffer
+        HeaderWriter writer(*this);
+
+        bufferHeader("?");
+        aQuery->writeTo(writer);
+    }
+    bufferHeader(" HTTP/1.1\r\n");
+
+    if (iInflater)
+    {
+        // Let the server know we can decompress the body
+        sendHeader(HTTP_HEADER_ACCEPT_ENCODING, "gzip, deflate");
+    }
 
     // Everything has gone well
-    iState = eRequestStarted;
+    setState(eRequestStarted);
     return HTTP_SUCCESS;
 }
 
 void HttpStream::sendHeader(const char* aHeader)
 {
-    iStream->println(aHeader);
+    bufferHeader(aHeader);
+    bufferHeader("\r\n");
 }
 
 void HttpStream::sendHeader(const char* aHeaderName, const char* aHeaderValue)
 {
-    iStream->print(aHeaderName);
-    iStream->print(": ");
-    iStream->println(aHeaderValue);
+    bufferHeader(aHeaderName);
+    bufferHeader(": ");
+    bufferHeader(aHeaderValue);
+    bufferHeader("\r\n");
 }
 
 void HttpStream::sendHeader(const char* aHeaderName, const int aHeaderValue)
 {
-    iStream->print(aHeaderName);
-    iStream->print(": ");
-    iStream->println(aHeaderValue);
+    bufferHeader(aHeaderName);
+    bufferHeader(": ");
+    bufferHeaderValue(aHeaderValue);
+    bufferHeader("\r\n");
+}
+
+void HttpStream::sendLengthHeader(const char* aHeaderName, tHttpLength aLength)
+{
+    bufferHeader(aHeaderName);
+    bufferHeader(": ");
+    bufferHeaderValue(aLength);
+    bufferHeader("\r\n");
 }
 
 void HttpStream::sendBasicAuth(const char* aUser, const char* aPassword)
 {
     // Send the initial part of this header line
-    iStream->print("Authorization: Basic ");
+    bufferHeader("Authorization: Basic ");
     // Now Base64 encode "aUser:aPassword" and send that
     // This seems trickier than it should be but it's mostly to avoid either
     // (a) some arbitrarily sized buffer which hopes to be big enough, or
@@ -157,20 +319,160 @@ void HttpStream::sendBasicAuth(const char* aUser, const char* aPassword)
             // NUL-terminate the output string
             output[4] = '\0';
             // And write it out
-            iStream->print((char*)output);
+            bufferHeader((char*)output);
 // FIXME We might want to fill output with '=' characters if b64_encode doesn't
 // FIXME do it for us when we're encoding the final chunk
             inputOffset = 0;
         }
     }
     // And end the header we've sent
-    iStream->println();
+    bufferHeader("\r\n");
 }
 
 void HttpStream::finishHeaders()
 {
-    iStream->println();
-    iState = eRequestSent;
+    bufferHeader("\r\n");
+    // Send the whole lot in one go
+    flushHeaders();
+    setState(eRequestSent);
+    // Get ready for the response, unless we're already waiting for the
+    // one to an earlier request
+    if (iQueuedResponses == 0)
+    {
+        resetResponseState();
+    }
+}
+
+void HttpStream::bufferHeader(const uint8_t* aData, size_t aLength)
+{
+    while (aLength > 0)
+    {
+        if ((iTxBufferLength == 0) && (aLength >= sizeof(iTxBuffer)))
+        {
+            // No point copying it, it wouldn't fit anyway
+            streamWrite(aData, aLength);
+            return;
+        }
+
+        size_t toCopy = sizeof(iTxBuffer) - iTxBufferLength;
+
+        if (aLength < toCopy)
+        {
+            toCopy = aLength;
+        }
+        memcpy(iTxBuffer + iTxBufferLength, aData, toCopy);
+        iTxBufferLength += toCopy;
+        aData += toCopy;
+        aLength -= toCopy;
+
+        if (iTxBufferLength == sizeof(iTxBuffer))
+        {
+            // Full, so send what we've got so far
+            flushHeaders();
+        }
+    }
+}
+
+void HttpStream::bufferHeaderValue(tHttpLength aValue)
+{
+    // Enough space for all the digits of a 64-bit number, plus its sign
+    char digits[21];
+    char* start = digits + sizeof(digits);
+    tHttpLength value = aValue;
+
+    // Work backwards from the least significant digit.  The remainder has
+    // the same sign as value, so this copes with the most negative number too
+    do
+    {
+        int digit = value % 10;
+
+        *--start = '0' + ((digit < 0) ? -digit : digit);
+        value /= 10;
+    } while (value);
+
+    if (aValue < 0)
+    {
+        *--start = '-';
+    }
+    bufferHeader((const uint8_t*)start, digits + sizeof(digits) - start);
+}
+
+void HttpStream::flushChunk()
+{
+    size_t length = iTxBufferLength - kChunkHeaderSize;
+
+    if (length == 0)
+    {
+        // Nothing to send, and an empty chunk would end the body
+        return;
+    }
+
+    // Fill in the chunk size in hex, working back from the end of the space
+    // we left for it, so the whole chunk can go in a single write
+    uint8_t* start = iTxBuffer + kChunkHeaderSize;
+    *--start = '\n';
+    *--start = '\r';
+    do
+    {
+        *--start = kHexDigits[length & 0xf];
+        length >>= 4;
+    } while (length);
+
+    iTxBuffer[iTxBufferLength++] = '\r';
+    iTxBuffer[iTxBufferLength++] = '\n';
+    streamWrite(start, iTxBuffer + iTxBufferLength - start);
+    iTxBufferLength = kChunkHeaderSize;
+}
+
+void HttpStream::sendChunk(const uint8_t* aData, size_t aLength)
+{
+    // Enough space for the size of the chunk as a 64-bit number in hex, plus
+    // the CRLF
+    uint8_t header[18];
+    uint8_t* start = header + sizeof(header);
+    size_t length = aLength;
+
+    *--start = '\n';
+    *--start = '\r';
+    do
+    {
+        *--start = kHexDigits[length & 0xf];
+        length >>= 4;
+    } while (length);
+
+    streamWrite(start, header + sizeof(header) - start);
+    streamWrite(aData, aLength);
+    streamWrite((const uint8_t*)"\r\n", 2);
+}
+
+void HttpStream::flushHeaders()
+{
+    if (iTxBufferLength > 0)
+    {
+        streamWrite(iTxBuffer, iTxBufferLength);
+        iTxBufferLength = 0;
+    }
+}
+
+size_t HttpStream::streamWrite(const uint8_t* aData, size_t aLength)
+{
+    size_t ret = iStream->write(aData, aLength);
+
+    iStats.requestBytes += ret;
+    iStats.writeCalls++;
+    return ret;
+}
+
+void HttpStream::finishResponse()
+{
+    if (skipResponseBody() != HTTP_SUCCESS)
+    {
+        // The connection should've been closed, but in case it hasn't
+        // just throw away whatever has already arrived
+        flushStreamRx();
+    }
+
+    resetState();
 }
 
 void HttpStream::flushStreamRx()
@@ -184,23 +486,122 @@ void HttpStream::flushStreamRx()
 void HttpStream::endRequest()
 {
     beginBody();
+
+    if (iTxDeflating)
+    {
+        // Send the rest of the compressed data
+        iTxDeflating = false;
+        iDeflater->end();
+    }
+
+    if (iTxChunked)
+    {
+        // Send whatever's left, followed by the last (empty) chunk
+        flushChunk();
+        streamWrite((const uint8_t*)"0\r\n\r\n", 5);
+        iTxChunked = false;
+        iTxBufferLength = 0;
+    }
 }
 
-void HttpStream::beginBody()
+void HttpStream::beginBody(bool aChunked)
 {
     if (iState < eRequestSent)
     {
+        if (aChunked)
+        {
+            sendHeader(HTTP_HEADER_TRANSFER_ENCODING, HTTP_HEADER_VALUE_CHUNKED);
+            if (iDeflater)
+            {
+                sendHeader(HTTP_HEADER_CONTENT_ENCODING, "deflate");
+            }
+        }
         // We still need to finish off the headers
         finishHeaders();
+
+        if (aChunked)
+        {
+            // Now the headers have gone we can use iTxBuffer to build up
+            // the chunks, leaving space at the start for the chunk size
+            iTxChunked = true;
+            iTxBufferLength = kChunkHeaderSize;
+
+            if (iDeflater)
+            {
+                iDeflater->begin(*this);
+                iTxDeflating = true;
+            }
+        }
     }
     // else the end of headers has already been sent, so nothing to do here
 }
 
+size_t HttpStream::write(const uint8_t *aBuffer, size_t aSize)
+{
+    // The 1st call to this indicates the user is sending the body, so if need
+    // be we should finish the header first
+    if (iState < eRequestSent)
+    {
+        finishHeaders();
+    }
+
+    if (iTxDeflating)
+    {
+        // Compress it, with the result coming back through here to be sent
+        iTxDeflating = false;
+        size_t ret = iDeflater->write(aBuffer, aSize);
+        iTxDeflating = true;
+        return ret;
+    }
+
+    if (!iTxChunked)
+    {
+        return streamWrite(aBuffer, aSize);
+    }
+
+    // Leave space at the end of iTxBuffer for the CRLF after the chunk data
+    const size_t chunkEnd = sizeof(iTxBuffer) - 2;
+    size_t remaining = aSize;
+
+    while (remaining > 0)
+    {
+        if ((iTxBufferLength == kChunkHeaderSize) && (remaining >= chunkEnd - kChunkHeaderSize))
+        {
+            // There's at least a full chunk's worth, so send it as it is
+            // rather than copying it
+            sendChunk(aBuffer, remaining);
+            break;
+        }
+
+        size_t toCopy = chunkEnd - iTxBufferLength;
+
+        if (remaining < toCopy)
+        {
+            toCopy = remaining;
+        }
+        memcpy(iTxBuffer + iTxBufferLength, aBuffer, toCopy);
+        iTxBufferLength += toCopy;
+        aBuffer += toCopy;
+        remaining -= toCopy;
+
+        if (iTxBufferLength == chunkEnd)
+        {
+            flushChunk();
+        }
+    }
+    return aSize;
+}
+
 int HttpStream::get(const char* aURLPath)
 {
     return startRequest(aURLPath, HTTP_METHOD_GET);
 }
 
+int HttpStream::get(const char* aURLPath, HttpForm& aQuery)
+{
+    return startRequest(aURLPath, aQuery, HTTP_METHOD_GET);
+}
+
 int HttpStream::get(const String& aURLPath)
 {
     return get(aURLPath.c_str());
@@ -306,7 +707,7 @@ int HttpStream::del(const char* aURLPath, const char* aContentType, int aContent
     return startRequest(aURLPath, HTTP_METHOD_DELETE, aContentType, aContentLength, aBody);
 }
 
-int HttpStream::responseStatusCode()
+int HttpStream::poll()
 {
     if (iState < eRequestSent)
     {
@@ -316,148 +717,183 @@ int HttpStream::responseStatusCode()
     //   HTTP-Version SP Status-Code SP Reason-Phrase CRLF
     // Where HTTP-Version is of the form:
     //   HTTP-Version   = "HTTP" "/" 1*DIGIT "." 1*DIGIT
-
-    int c = '\0';
-    do
+    while (iState < eStatusCodeRead)
     {
-        // Make sure the status code is reset, and likewise the state.  This
-        // lets us easily cope with 1xx informational responses by just
-        // ignoring them really, and reading the next line for a proper response
-        iStatusCode = 0;
-        iState = eRequestSent;
+        if (!iStream->available())
+        {
+            return HTTP_POLL_IN_PROGRESS;
+        }
+
+        int c = iStream->read();
+
+        iStats.responseBytes++;
+        if (iStats.headerBytes++ == 0)
+        {
+            iStats.firstByteTime = sinceRequestStart();
+        }
 
-        unsigned long timeoutStart = millis();
-        // Psuedo-regexp we're expecting before the status-code
-        const char* statusPrefix = "HTTP/*.* ";
-        const char* statusPtr = statusPrefix;
-        // Whilst we haven't timed out & haven't reached the end of the headers
-        while ((c != '\n') && 
-               ( (millis() - timeoutStart) < iHttpResponseTimeout ))
+        switch(iState)
         {
-            if (available())
+        case eRequestSent:
+            // We haven't reached the status code yet
+            if ( (iStatusPtr == kStatusPrefix) && (c == '\r' || c == '\n') )
+            {
+                // Blank line left over from an informational response
+                continue;
+            }
+            else if ( (*iStatusPtr == '*') || (*iStatusPtr == c) )
             {
-                c = read();
-                if (c != -1)
+                // This character matches, just move along
+                iStatusPtr++;
+                if (*iStatusPtr == '\0')
                 {
-                    switch(iState)
-                    {
-                    case eRequestSent:
-                        // We haven't reached the status code yet
-                        if ( (*statusPtr == '*') || (*statusPtr == c) )
-                        {
-                            // This character matches, just move along
-                            statusPtr++;
-                            if (*statusPtr == '\0')
-                            {
-                                // We've reached the end of the prefix
-                                iState = eReadingStatusCode;
-                            }
-                        }
-                        else
-                        {
-                            return HTTP_ERROR_INVALID_RESPONSE;
-                        }
-                        break;
-                    case eReadingStatusCode:
-                        if (isdigit(c))
-                        {
-                            // This assumes we won't get more than the 3 digits we
-                            // want
-                            iStatusCode = iStatusCode*10 + (c - '0');
-                        }
-                        else
-                        {
-                            // We've reached the end of the status code
-                            // We could sanity check it here or double-check for ' '
-                            // rather than anything else, but let's be lenient
-                            iState = eStatusCodeRead;
-                        }
-                        break;
-                    case eStatusCodeRead:
-                        // We're just waiting for the end of the line now
-                        break;
-
-                    default:
-                        break;
-                    };
-                    // We read something, reset the timeout counter
-                    timeoutStart = millis();
+                    // We've reached the end of the prefix
+                    setState(eReadingStatusCode);
                 }
             }
             else
             {
-                // We haven't got any data, so let's pause to allow some to
-                // arrive
-                delay(kHttpWaitForDataDelay);
+                return HTTP_ERROR_INVALID_RESPONSE;
             }
-        }
-        if ( (c == '\n') && (iStatusCode < 200 && iStatusCode != 101) )
+            break;
+        case eReadingStatusCode:
+            if (isdigit(c))
+            {
+                // This assumes we won't get more than the 3 digits we
+                // want
+                iStatusCode = iStatusCode*10 + (c - '0');
+            }
+            else
+            {
+                // We've reached the end of the status code
+                // We could sanity check it here or double-check for ' '
+                // rather than anything else, but let's be lenient
+                setState(eSkipToEndOfStatusLine);
+            }
+            break;
+        default:
+            // We're just waiting for the end of the line now
+            break;
+        };
+
+        if (c == '\n')
         {
-            // We've reached the end of an informational status line
-            c = '\0'; // Clear c so we'll go back into the data reading loop
+            if (iState != eSkipToEndOfStatusLine)
+            {
+                // This wasn't a properly formed status line, or at least not
+                // one we could understand
+                return HTTP_ERROR_INVALID_RESPONSE;
+            }
+            else if (iStatusCode < 200 && iStatusCode != 101)
+            {
+                // We've reached the end of an informational status line, so
+                // just ignore it and go back to waiting for a proper response
+                iStatusCode = 0;
+                iStatusPtr = kStatusPrefix;
+                setState(eRequestSent);
+            }
+            else
+            {
+                // We've read the status-line successfully
+                setState(eStatusCodeRead);
+                iStats.statusTime = sinceRequestStart();
+                cacheStatusRead();
+                return HTTP_POLL_STATUS_READY;
+            }
         }
     }
-    // If we've read a status code successfully but it's informational (1xx)
-    // loop back to the start
-    while ( (iState == eStatusCodeRead) && (iStatusCode < 200 && iStatusCode != 101) );
 
-    if ( (c == '\n') && (iState == eStatusCodeRead) )
-    {
-        // We've read the status-line successfully
-        return iStatusCode;
-    }
-    else if (c != '\n')
-    {
-        // We must've timed out before we reached the end of the line
-        return HTTP_ERROR_TIMED_OUT;
-    }
-    else
+    // Carry on through the headers with whatever has arrived so far
+    while (!endOfHeadersReached())
     {
-        // This wasn't a properly formed status line, or at least not one we
-        // could understand
-        return HTTP_ERROR_INVALID_RESPONSE;
+        if (!iStream->available())
+        {
+            return HTTP_POLL_IN_PROGRESS;
+        }
+        (void)readHeader();
     }
+    // We can't find the end of a body whose length we couldn't hold
+    return iInvalidLength ? HTTP_ERROR_INVALID_RESPONSE : HTTP_POLL_HEADERS_DONE;
 }
 
-int HttpStream::skipResponseHeaders()
+int HttpStream::waitForResponse(tHttpState aState)
 {
-    // Just keep reading until we finish reading the headers or time out
-    unsigned long timeoutStart = millis();
-    // Whilst we haven't timed out & haven't reached the end of the headers
-    while ((!endOfHeadersReached()) && 
-           ( (millis() - timeoutStart) < iHttpResponseTimeout ))
+    unsigned long timeoutStart = iClock->now();
+    // Whilst we haven't timed out & haven't reached aState
+    while (iState < aState)
     {
-        if (available())
+        if (iStream->available())
         {
-            (void)readHeader();
+            int ret = poll();
+
+            if (ret < 0)
+            {
+                return ret;
+            }
             // We read something, reset the timeout counter
-            timeoutStart = millis();
+            timeoutStart = iClock->now();
         }
-        else
+        else if (!waitForData(timeoutStart))
         {
-            // We haven't got any data, so let's pause to allow some to
-            // arrive
-            delay(kHttpWaitForDataDelay);
+            return HTTP_ERROR_TIMED_OUT;
         }
     }
-    if (endOfHeadersReached())
+    return HTTP_SUCCESS;
+}
+
+#ifdef HTTP_STATE_TRACE
+void HttpStream::setState(tHttpState aState)
+{
+    if (iStateTraceCallback && (aState != iState))
     {
-        // Success
-        return HTTP_SUCCESS;
+        iStateTraceCallback(iState, aState, iClock->now(), iStats.responseBytes, iStateTraceContext);
     }
-    else
+    iState = aState;
+}
+#endif
+
+void HttpStream::setClock(HttpClock* aClock)
+{
+    iClock = aClock ? aClock : &defaultClock;
+}
+
+bool HttpStream::waitForData(unsigned long aTimeoutStart)
+{
+    if ((iClock->now() - aTimeoutStart) >= iHttpResponseTimeout)
     {
-        // We must've timed out
-        return HTTP_ERROR_TIMED_OUT;
+        return false;
+    }
+    // We haven't got any data, so let's pause to allow some to arrive
+    iStats.waits++;
+    iClock->wait(kHttpWaitForDataDelay);
+    return true;
+}
+
+int HttpStream::responseStatusCode()
+{
+    if (iState < eRequestSent)
+    {
+        return HTTP_ERROR_API;
     }
+
+    int ret = waitForResponse(eStatusCodeRead);
+
+    return (HTTP_SUCCESS == ret) ? iStatusCode : ret;
+}
+
+int HttpStream::skipResponseHeaders()
+{
+    // Just keep reading until we finish reading the headers or time out
+    return waitForResponse(eReadingBody);
 }
 
 bool HttpStream::endOfHeadersReached()
 {
-    return (iState == eReadingBody || iState == eReadingChunkLength || iState == eReadingBodyChunk);
+    // All of the states from eReadingBody on are for the body
+    return (iState >= eReadingBody);
 };
 
-int HttpStream::contentLength()
+tHttpLength HttpStream::contentLength()
 {
     // skip the response headers, if they haven't been read already 
     if (!endOfHeadersReached())
@@ -470,9 +906,15 @@ int HttpStream::contentLength()
 
 String HttpStream::responseBody()
 {
-    int bodyLength = contentLength();
+    tHttpLength bodyLength = contentLength();
     String response;
 
+    if ((bodyLength > 0) && ((tHttpLength)(unsigned int)bodyLength != bodyLength))
+    {
+        // Too big for a String, use responseBody(Print&) for it instead
+        return String((const char*)NULL);
+    }
+
     if (bodyLength > 0)
     {
         // try to reserve bodyLength bytes
@@ -482,11 +924,16 @@ String HttpStream::responseBody()
         }
     }
 
+    if (iDecoding)
+    {
+        // The body will be longer than that once it's decompressed
+        bodyLength = kNoContentLengthHeader;
+    }
+
     // keep on timedRead'ing, until:
-    //  - we have a content length: body length equals consumed or no bytes
-    //                              available
-    //  - no content length:        no bytes are available
-    while (iBodyLengthConsumed != bodyLength)
+    //  - we know where the body ends: we've reached it or no bytes available
+    //  - otherwise:                   no bytes are available
+    while (!endOfBodyReached())
     {
         int c = timedRead();
 
@@ -501,7 +948,7 @@ String HttpStream::responseBody()
         }
     }
 
-    if (bodyLength > 0 && (unsigned int)bodyLength != response.length()) {
+    if (bodyLength > 0 && (tHttpLength)response.length() != bodyLength) {
         // failure, we did not read in reponse content length bytes
         return String((const char*)NULL);
     }
@@ -509,155 +956,1291 @@ String HttpStream::responseBody()
     return response;
 }
 
-bool HttpStream::endOfBodyReached()
+int HttpStream::timedRead()
 {
-    if (endOfHeadersReached() && (contentLength() != kNoContentLengthHeader))
+    unsigned long timeoutStart = iClock->now();
+
+    do
     {
-        // We've got to the body and we know how long it will be
-        return (iBodyLengthConsumed >= contentLength());
-    }
-    return false;
+        int c = read();
+
+        if (c >= 0)
+        {
+            return c;
+        }
+        iStats.waits++;
+        iClock->wait(0);
+    } while ((iClock->now() - timeoutStart) < _timeout);
+    return -1;
 }
 
-int HttpStream::available()
+int HttpStream::responseBody(uint8_t* aBuffer, size_t aSize)
 {
-    if (iState == eReadingChunkLength)
+    // This reads the rest of the headers, if there are any left
+    contentLength();
+
+    if (!endOfHeadersReached())
     {
-        while (iStream->available())
-        {
-            char c = iStream->read();
+        // We didn't get to the end of the headers
+        return HTTP_ERROR_TIMED_OUT;
+    }
 
-            if (c == '\n')
-            {
-                iState = eReadingBodyChunk;
+    size_t count = readBytes(aBuffer, aSize);
+
+    if (bodyEndKnown() && (count < aSize) && !endOfBodyReached())
+    {
+        // It stopped arriving before the end
+        return HTTP_ERROR_TIMED_OUT;
+    }
+    return count;
+}
+
+tHttpLength HttpStream::responseBody(Print& aOutput)
+{
+    tHttpLength copied = 0;
+    int ret = copyBody(aOutput, copied);
+
+    return (HTTP_SUCCESS == ret) ? copied : ret;
+}
+
+int HttpStream::copyBody(Print& aOutput, tHttpLength& aCopied)
+{
+    if (!endOfHeadersReached())
+    {
+        int ret = skipResponseHeaders();
+
+        if (HTTP_SUCCESS != ret)
+        {
+            return ret;
+        }
+    }
+
+    uint8_t block[HTTP_RX_BLOCK_SIZE];
+
+    while (!endOfBodyReached())
+    {
+        size_t count = readBytes(block, sizeof(block));
+
+        if (count == 0)
+        {
+            // Either the end of the body or it's stopped arriving
+            break;
+        }
+
+        size_t written = aOutput.write(block, count);
+
+        aCopied += written;
+        if (written != count)
+        {
+            return HTTP_ERROR_WRITE_FAILED;
+        }
+    }
+
+    if (iInvalidLength)
+    {
+        // The chunk framing had a size we couldn't hold
+        return HTTP_ERROR_INVALID_RESPONSE;
+    }
+    else if (bodyEndKnown() && !endOfBodyReached())
+    {
+        // It stopped arriving before the end
+        return HTTP_ERROR_TIMED_OUT;
+    }
+    return HTTP_SUCCESS;
+}
+
+int HttpStream::download(const char* aURLPath, Print& aOutput, HttpDownload& aDownload)
+{
+    // We can only ask for the rest if we can be sure it's from the same
+    // version of the resource.  A weak ETag isn't good enough for that
+    const char* validator = NULL;
+
+    if (aDownload.iETag[0] && strncmp(aDownload.iETag, "W/", 2))
+    {
+        validator = aDownload.iETag;
+    }
+    else if (aDownload.iLastModified[0])
+    {
+        validator = aDownload.iLastModified;
+    }
+
+    // The ranges are of the body as it's sent, so don't ask for it to be
+    // compressed, or for the cache to get involved
+    Inflater* inflater = iInflater;
+    HttpCache* cache = iCache;
+    iInflater = NULL;
+    iCache = NULL;
+
+    beginRequest();
+    int ret = get(aURLPath);
+
+    if (HTTP_SUCCESS == ret)
+    {
+        if ((aDownload.iOffset > 0) && validator)
+        {
+            bufferHeader(HTTP_HEADER_RANGE ": bytes=");
+            bufferHeaderValue(aDownload.iOffset);
+            bufferHeader("-\r\n");
+            sendHeader(HTTP_HEADER_IF_RANGE, validator);
+        }
+        endRequest();
+    }
+
+    // Collect the validators from the response, without upsetting anyone
+    // who has asked for them with captureHeader()
+    char etag[HTTP_DOWNLOAD_VALIDATOR_SIZE] = "";
+    char lastModified[HTTP_DOWNLOAD_VALIDATOR_SIZE] = "";
+    const uint8_t indices[] = { eHeaderETag, eHeaderLastModified };
+    char* const buffers[] = { etag, lastModified };
+    char* userValues[2];
+    size_t userSizes[2];
+    uint16_t userMask = iHeaderWatchMask;
+
+    for (int i = 0; i < 2; i++)
+    {
+        userValues[i] = iHeaderValues[indices[i]];
+        userSizes[i] = iHeaderValueSizes[indices[i]];
+        iHeaderValues[indices[i]] = buffers[i];
+        iHeaderValueSizes[indices[i]] = HTTP_DOWNLOAD_VALIDATOR_SIZE;
+        iHeaderWatchMask |= (1 << indices[i]);
+    }
+
+    if (HTTP_SUCCESS == ret)
+    {
+        ret = skipResponseHeaders();
+    }
+
+    iInflater = inflater;
+    iCache = cache;
+    for (int i = 0; i < 2; i++)
+    {
+        if (userValues[i])
+        {
+            strncpy(userValues[i], buffers[i], userSizes[i] - 1);
+            userValues[i][userSizes[i] - 1] = '\0';
+        }
+        iHeaderValues[indices[i]] = userValues[i];
+        iHeaderValueSizes[indices[i]] = userSizes[i];
+
+        if (strlen(buffers[i]) == HTTP_DOWNLOAD_VALIDATOR_SIZE - 1)
+        {
+            // It might not have fitted, so we can't rely on it
+            buffers[i][0] = '\0';
+        }
+    }
+    iHeaderWatchMask = userMask;
+
+    if (HTTP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    if (iStatusCode == 206)
+    {
+        if (iContentRangeStart != aDownload.iOffset)
+        {
+            // That isn't the part we asked for
+            return HTTP_ERROR_INVALID_RESPONSE;
+        }
+    }
+    else if (iStatusCode == 200)
+    {
+        if (aDownload.iOffset > 0)
+        {
+            bool unchanged = etag[0] ? !strcmp(etag, aDownload.iETag) :
+                                       (lastModified[0] && !strcmp(lastModified, aDownload.iLastModified));
+
+            if (!unchanged)
+            {
+                // It's a different version, so it'll have to start again
+                aDownload.reset();
+                strcpy(aDownload.iETag, etag);
+                strcpy(aDownload.iLastModified, lastModified);
+                return HTTP_ERROR_CONTENT_CHANGED;
+            }
+
+            // The server doesn't do ranges, so skip the part we've already
+            // got
+            uint8_t discard[HTTP_RX_BLOCK_SIZE];
+            tHttpLength toSkip = aDownload.iOffset;
+
+            while (toSkip > 0)
+            {
+                size_t count = readBytes(discard, (toSkip < (tHttpLength)sizeof(discard)) ? (size_t)toSkip : sizeof(discard));
+
+                if (count == 0)
+                {
+                    return HTTP_ERROR_TIMED_OUT;
+                }
+                toSkip -= count;
+            }
+        }
+    }
+    else if ((iStatusCode == 416) && (iContentRangeTotal == aDownload.iOffset))
+    {
+        // We'd already got all of it
+        return HTTP_SUCCESS;
+    }
+    else
+    {
+        return iStatusCode;
+    }
+
+    if (etag[0] || lastModified[0] || (iStatusCode == 200))
+    {
+        strcpy(aDownload.iETag, etag);
+        strcpy(aDownload.iLastModified, lastModified);
+    }
+
+    // This keeps track of how far we've got as it goes, so we know where to
+    // carry on from if it stops
+    return copyBody(aOutput, aDownload.iOffset);
+}
+
+bool HttpStream::canReuseConnection()
+{
+    // We can only find the start of the next response if we know where
+    // this one ends.  This also makes sure we've read all the headers
+    bool knownLength = (contentLength() != kNoContentLengthHeader) || iIsChunked;
+
+    return knownLength && !iConnectionClose && !iInvalidLength;
+}
+
+int HttpStream::skipResponseBody(long aMaxLength)
+{
+    if (iState < eRequestSent)
+    {
+        // There's no response to skip
+        return HTTP_SUCCESS;
+    }
+
+    if (!endOfHeadersReached())
+    {
+        int ret = skipResponseHeaders();
+
+        if (HTTP_SUCCESS != ret)
+        {
+            return ret;
+        }
+    }
+
+    if (iCacheState == eCacheServing)
+    {
+        // The body came from the cache, so there's nothing left to read
+        iCacheState = eCacheUnused;
+        iContentLength = 0;
+        iBodyLengthConsumed = 0;
+    }
+    else if (iCacheState == eCacheStoring)
+    {
+        // Nobody wanted it, so there's no point keeping it
+        endCaching(false);
+    }
+
+    // There's no point decompressing what we're throwing away
+    iDecoding = false;
+
+    if (!canReuseConnection() ||
+        (!iIsChunked && ((contentLength() - iBodyLengthConsumed) > aMaxLength)))
+    {
+        // Either we can't tell where this response ends or there's more
+        // than it's worth waiting for
+        return HTTP_ERROR_CONNECTION_CLOSE;
+    }
+
+    uint8_t discard[HTTP_RX_BLOCK_SIZE];
+    // We can't tell in advance how much of a chunked body is left, so keep
+    // count as we go
+    long discarded = 0;
+
+    while (!endOfBodyReached())
+    {
+        size_t count = readBytes(discard, sizeof(discard));
+
+        if (count == 0)
+        {
+            // It's stopped arriving
+            return HTTP_ERROR_TIMED_OUT;
+        }
+
+        discarded += count;
+        if (discarded > aMaxLength)
+        {
+            return HTTP_ERROR_CONNECTION_CLOSE;
+        }
+    }
+    return HTTP_SUCCESS;
+}
+
+int HttpStream::nextResponse()
+{
+    if (iQueuedResponses == 0)
+    {
+        return HTTP_ERROR_API;
+    }
+
+    // The next response follows straight on from this one, so we have to
+    // read all of it however long it is
+    int ret = skipResponseBody(LONG_MAX);
+
+    if (HTTP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    iQueuedResponses--;
+    resetResponseState();
+    setState(eRequestSent);
+    return HTTP_SUCCESS;
+}
+
+bool HttpStream::endOfBodyReached()
+{
+    if (iCacheState == eCacheServing)
+    {
+        return (iCache->available() == 0);
+    }
+    else if (iDecoding)
+    {
+        // The compressed data marks its own end
+        return iInflater->finished();
+    }
+    return endOfRawBodyReached();
+}
+
+bool HttpStream::bodyEndKnown()
+{
+    // A chunked body's end is marked by its last chunk, and compressed data
+    // marks its own end, so we can tell if those have been cut short too
+    return (contentLength() != kNoContentLengthHeader) || iIsChunked || iDecoding;
+}
+
+bool HttpStream::endOfRawBodyReached()
+{
+    if (endOfHeadersReached() && iIsChunked)
+    {
+        // The body ends after the last chunk and its trailer
+        readChunkFraming();
+        return (iState == eEndOfChunkedBody);
+    }
+    else if (endOfHeadersReached() && (contentLength() != kNoContentLengthHeader))
+    {
+        // We've got to the body and we know how long it will be
+        return (iBodyLengthConsumed >= contentLength());
+    }
+    return false;
+}
+
+int HttpStream::available()
+{
+    if (iCacheState == eCacheServing)
+    {
+        long ret = iCache->available();
+
+        return (ret > INT_MAX) ? INT_MAX : ret;
+    }
+    else if (iDecoding)
+    {
+        // We can't tell how much the compressed data will expand to, only
+        // that there's some to be had
+        if (iInflater->available() > 0)
+        {
+            return iInflater->available();
+        }
+        return (!iInflater->finished() && !iInflater->failed() && (rawAvailable() > 0)) ? 1 : 0;
+    }
+    return rawAvailable();
+}
+
+int HttpStream::rawAvailable()
+{
+    readChunkFraming();
+
+    if ((iState > eReadingBody) && (iState != eReadingBodyChunk))
+    {
+        // We're part way through the chunk framing, or past the end of the
+        // body, so there's no data for the user yet
+        return 0;
+    }
+
+    int clientAvailable = iStream->available();
+
+    if ((iState == eReadingBodyChunk) && (iChunkLength < clientAvailable))
+    {
+        return (int)iChunkLength;
+    }
+    else
+    {
+        return clientAvailable;
+    }
+}
+
+void HttpStream::readChunkFraming()
+{
+    // Work through any chunk sizes, extensions and trailers that have
+    // arrived, stopping at the next chunk's data or the end of the body
+    while ((iState > eReadingBody) && (iState != eReadingBodyChunk) &&
+           (iState != eEndOfChunkedBody) && !iInvalidLength && iStream->available())
+    {
+        char c = iStream->read();
+
+        iStats.responseBytes++;
+        switch(iState)
+        {
+        case eReadingChunkLength:
+            if (hexValue(c) < 16)
+            {
+                if (!appendDigit(iChunkLength, 16, hexValue(c)))
+                {
+                    // We'd lose track of where the chunk ends, so stop here
+                    iInvalidLength = true;
+                }
+            }
+            else if (c == '\n')
+            {
+                startChunk();
+            }
+            else if (c != '\r')
+            {
+                // Anything else, e.g. ';', starts a chunk extension, which
+                // we don't need
+                setState(eReadingChunkExtension);
+            }
+            break;
+        case eReadingChunkExtension:
+            if (c == '\n')
+            {
+                startChunk();
+            }
+            break;
+        case eReadingChunkEnd:
+            // Skip over the CRLF after the chunk data
+            if (c == '\n')
+            {
+                setState(eReadingChunkLength);
+                iChunkLength = 0;
+            }
+            break;
+        case eReadingTrailer:
+            // We're at the start of a line of the trailer
+            if (c == '\n')
+            {
+                // An empty line, so that's the end of the body
+                setState(eEndOfChunkedBody);
+            }
+            else if (c != '\r')
+            {
+                // Trailers are just like headers, except the ones that
+                // describe the body aren't allowed
+                iHeaderMatches = iHeaderWatchMask & ~((1 << eHeaderContentLength) |
+                                                      (1 << eHeaderTransferEncoding) |
+                                                      (1 << eHeaderContentEncoding) |
+                                                      (1 << eHeaderConnection) |
+                                                      (1 << eHeaderContentRange));
+                iHeaderNameIndex = 0;
+                setState(matchHeaderName(c) ? eReadingTrailerName : eSkipToEndOfTrailer);
+            }
+            break;
+        case eReadingTrailerName:
+            if ((c == '\n') || !matchHeaderName(c))
+            {
+                setState((c == '\n') ? eReadingTrailer : eSkipToEndOfTrailer);
+            }
+            else if (c == ':')
+            {
+                setState(eReadingTrailerValue);
+            }
+            break;
+        case eReadingTrailerValue:
+            processHeaderValue(c);
+            if (c == '\n')
+            {
+                setState(eReadingTrailer);
+            }
+            break;
+        default:
+            // We're just waiting for the end of the line now
+            if (c == '\n')
+            {
+                setState(eReadingTrailer);
+            }
+            break;
+        };
+    }
+}
+
+void HttpStream::startChunk()
+{
+    if (iChunkLength > 0)
+    {
+        setState(eReadingBodyChunk);
+    }
+    else
+    {
+        // This is the last chunk, there's only the trailer to come
+        setState(eReadingTrailer);
+    }
+}
+
+int HttpStream::read()
+{
+    if (iDecoding || (iCacheState >= eCacheStoring))
+    {
+        uint8_t b;
+        return (HttpStream::read(&b, 1) == 1) ? b : -1;
+    }
+
+    if (iIsChunked && !rawAvailable())
+    {
+        return -1;
+    }
+
+    int ret = iStream->read();
+    if (ret >= 0)
+    {
+        iStats.responseBytes++;
+        if (endOfHeadersReached())
+        {
+            countBody(1);
+        }
+
+        if (endOfHeadersReached() && iContentLength > 0)
+        {
+            // We're outputting the body now and we've seen a Content-Length header
+            // So keep track of how many bytes are left
+            iBodyLengthConsumed++;
+        }
+
+        if (iState == eReadingBodyChunk)
+        {
+            iChunkLength--;
+
+            if (iChunkLength == 0)
+            {
+                setState(eReadingChunkEnd);
+            }
+        }
+    }
+    return ret;
+}
+
+int HttpStream::read(uint8_t *aBuffer, size_t aSize)
+{
+    int ret;
+
+    if (iCacheState == eCacheServing)
+    {
+        ret = iCache->read(aBuffer, aSize);
+        iBodyLengthConsumed += ret;
+    }
+    else if (!iDecoding)
+    {
+        ret = rawRead(aBuffer, aSize);
+    }
+    else
+    {
+        ret = iInflater->read(aBuffer, aSize);
+
+        if (ret == Inflater::kNotYet)
+        {
+            ret = -1;
+        }
+        else if (iInflater->finished() && (ret == 0))
+        {
+            // Throw away anything the server sent after the compressed data,
+            // so it isn't mistaken for the next response
+            while (rawRead(aBuffer, aSize) > 0)
+            {
+            }
+        }
+    }
+
+    if (ret > 0)
+    {
+        countBody(ret);
+    }
+
+    if ((iCacheState == eCacheStoring) && (ret >= 0))
+    {
+        if ((ret > 0) && !iCache->store(aBuffer, ret))
+        {
+            endCaching(false);
+        }
+        else if (endOfBodyReached())
+        {
+            endCaching(true);
+        }
+    }
+    return ret;
+}
+
+void HttpStream::countBody(size_t aLength)
+{
+    iStats.bodyBytes += aLength;
+    iStats.bodyTime = sinceRequestStart();
+}
+
+int HttpStream::rawRead(uint8_t *aBuffer, size_t aSize)
+{
+    // This also steps over any chunk header and limits us to the rest of the
+    // current chunk
+    int avail = rawAvailable();
+
+    if (avail <= 0)
+    {
+        // Once a length has been too big there's no more of the body we
+        // can make sense of
+        return (endOfRawBodyReached() || iInvalidLength) ? 0 : -1;
+    }
+
+    size_t toRead = aSize;
+
+    if ((size_t)avail < toRead)
+    {
+        toRead = avail;
+    }
+
+    bool countingBody = endOfHeadersReached() && iContentLength > 0;
+
+    if (countingBody)
+    {
+        // Don't read past the end of the body into whatever follows it
+        tHttpLength remaining = iContentLength - iBodyLengthConsumed;
+
+        if (remaining <= 0)
+        {
+            return 0;
+        }
+        else if (remaining < (tHttpLength)toRead)
+        {
+            toRead = (size_t)remaining;
+        }
+    }
+
+    int ret = iStream->readBytes(aBuffer, toRead);
+
+    if (ret > 0)
+    {
+        iStats.responseBytes += ret;
+        if (countingBody)
+        {
+            iBodyLengthConsumed += ret;
+        }
+
+        if (iState == eReadingBodyChunk)
+        {
+            iChunkLength -= ret;
+
+            if (iChunkLength == 0)
+            {
+                setState(eReadingChunkEnd);
+            }
+        }
+    }
+    return ret;
+}
+
+int HttpStream::fillInflater(uint8_t* aBuffer, size_t aSize, void* aContext)
+{
+    HttpStream* self = (HttpStream*)aContext;
+    int ret = self->rawRead(aBuffer, aSize);
+
+    // Don't wait for more, read() only returns what has already arrived and
+    // readBytes() does the waiting
+    return (ret < 0) ? Inflater::kNotYet : ret;
+}
+
+int HttpStream::readAvailable(uint8_t *aBuffer, size_t aSize)
+{
+    return HttpStream::read(aBuffer, aSize);
+}
+
+size_t HttpStream::readBytes(uint8_t *aBuffer, size_t aLength)
+{
+    size_t count = 0;
+    unsigned long timeoutStart = iClock->now();
+
+    while (count < aLength)
+    {
+        // Call our own version explicitly, subclasses build their read() on
+        // top of this
+        int ret = HttpStream::read(aBuffer + count, aLength - count);
+
+        if (ret > 0)
+        {
+            count += ret;
+            // We read something, reset the timeout counter
+            timeoutStart = iClock->now();
+
+            if (iProgressCallback)
+            {
+                iProgressCallback(iStats, iProgressContext);
+            }
+        }
+        else if ((ret == 0) || ((iClock->now() - timeoutStart) >= _timeout))
+        {
+            // Either the end of the body or we've given up waiting
+            break;
+        }
+        else
+        {
+            iStats.waits++;
+            iClock->wait(0);
+        }
+    }
+    return count;
+}
+
+bool HttpStream::headerAvailable()
+{
+    // clear the currently store header line
+    iHeaderLine = "";
+
+    while (!endOfHeadersReached())
+    {
+        // read a byte from the header
+        int c = readHeader();
+
+        if (c == '\r' || c == '\n')
+        {
+            if (iHeaderLine.length())
+            {
+                // end of the line, all done
                 break;
+            } 
+            else
+            {
+                // ignore any CR or LF characters
+                continue;
             }
-            else if (c == '\r')
+        }
+
+        // append byte to header line
+        iHeaderLine += (char)c;
+    }
+
+    return (iHeaderLine.length() > 0);
+}
+
+int HttpStream::readHeaders(char* aBuffer, size_t aBufferSize,
+                            tHeaderCallback aCallback, void* aContext,
+                            tHeaderOverflow aOverflow)
+{
+    // Make sure we're past the status line
+    int ret = waitForResponse(eStatusCodeRead);
+
+    if (HTTP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    size_t lineLength = 0;
+    bool overflowed = false;
+    unsigned long timeoutStart = iClock->now();
+
+    while (!endOfHeadersReached())
+    {
+        if (!iStream->available())
+        {
+            if (!waitForData(timeoutStart))
             {
-                // no-op
+                return HTTP_ERROR_TIMED_OUT;
             }
-            else if (isHexadecimalDigit(c))
+            continue;
+        }
+        // We read something, reset the timeout counter
+        timeoutStart = iClock->now();
+
+        int c = readHeader();
+
+        if (c == '\n')
+        {
+            // End of the line, hand over the header unless we're dropping it
+            if ((lineLength > 0) && !(overflowed && (aOverflow == eHeaderSkip)))
             {
-                char digit[2] = {c, '\0'};
+                const char* colon = (const char*)memchr(aBuffer, ':', lineLength);
 
-                iChunkLength = (iChunkLength * 16) + strtol(digit, NULL, 16);
+                // Lines without a colon aren't headers, so just ignore them
+                if (colon)
+                {
+                    size_t nameLength = colon - aBuffer;
+                    const char* value = colon + 1;
+                    const char* valueEnd = aBuffer + lineLength;
+
+                    // trim any whitespace around the value
+                    while ((value < valueEnd) && isSpace(*value))
+                    {
+                        value++;
+                    }
+                    while ((valueEnd > value) && isSpace(valueEnd[-1]))
+                    {
+                        valueEnd--;
+                    }
+                    aCallback(aBuffer, nameLength, value, valueEnd - value, aContext);
+                }
             }
+            lineLength = 0;
+            overflowed = false;
+        }
+        else if (c == '\r')
+        {
+            // ignore any CR characters, the LF marks the end of the line
+        }
+        else if (lineLength < aBufferSize)
+        {
+            aBuffer[lineLength++] = c;
+        }
+        else if (aOverflow == eHeaderFail)
+        {
+            return HTTP_ERROR_HEADER_TOO_LONG;
+        }
+        else
+        {
+            overflowed = true;
         }
     }
+    return HTTP_SUCCESS;
+}
 
-    if (iState == eReadingBodyChunk && iChunkLength == 0)
-    {
-        iState = eReadingChunkLength;
-    }
-    
-    if (iState == eReadingChunkLength)
+String HttpStream::readHeaderName()
+{
+    int colonIndex = iHeaderLine.indexOf(':');
+
+    if (colonIndex == -1)
     {
-        return 0;
+        return "";
     }
-    
-    int clientAvailable = iStream->available();
 
-    if (iState == eReadingBodyChunk)
+    return iHeaderLine.substring(0, colonIndex);
+}
+
+String HttpStream::readHeaderValue()
+{
+    int colonIndex = iHeaderLine.indexOf(':');
+    int startIndex = colonIndex + 1;
+
+    if (colonIndex == -1)
     {
-        return min(clientAvailable, iChunkLength);
+        return "";
     }
-    else
+
+    // trim any leading whitespace
+    while (startIndex < (int)iHeaderLine.length() && isSpace(iHeaderLine[startIndex]))
     {
-        return clientAvailable;
+        startIndex++;
     }
-}
 
+    return iHeaderLine.substring(startIndex);
+}
 
-int HttpStream::read()
+bool HttpStream::captureHeader(const char* aName, char* aBuffer, size_t aBufferSize)
 {
-    if (iIsChunked && !available())
+    if (!aBuffer || (aBufferSize == 0))
     {
-        return -1;
+        return false;
     }
 
-    int ret = iStream->read();
-    if (ret >= 0)
+    // If we already know about this header, just give it somewhere to go
+    int index = 0;
+    while ((index < iHeaderCount) && strcasecmp(iHeaderNames[index], aName))
     {
-        if (endOfHeadersReached() && iContentLength > 0)
+        index++;
+    }
+
+    if (index == iHeaderCount)
+    {
+        if (iHeaderCount == kMaxHeadersOfInterest)
         {
-            // We're outputting the body now and we've seen a Content-Length header
-            // So keep track of how many bytes are left
-            iBodyLengthConsumed++;
+            return false;
         }
+        iHeaderNames[iHeaderCount++] = aName;
+    }
 
-        if (iState == eReadingBodyChunk)
-        {
-            iChunkLength--;
+    iHeaderValues[index] = aBuffer;
+    iHeaderValueSizes[index] = aBufferSize;
+    aBuffer[0] = '\0';
+    iHeaderWatchMask |= (1 << index);
+    return true;
+}
 
-            if (iChunkLength == 0)
+void HttpStream::clearCapturedHeaders()
+{
+    for (iHeaderCount = 0; iHeaderCount < eKnownHeaderCount; iHeaderCount++)
+    {
+        iHeaderNames[iHeaderCount] = kKnownHeaders[iHeaderCount];
+        iHeaderValues[iHeaderCount] = NULL;
+        iHeaderValueSizes[iHeaderCount] = 0;
+    }
+    // These are needed to work out where the body ends, whether it needs
+    // decompressing and whether the connection can be reused
+    iHeaderWatchMask = (1 << eHeaderContentLength) |
+                       (1 << eHeaderTransferEncoding) |
+                       (1 << eHeaderContentEncoding) |
+                       (1 << eHeaderConnection) |
+                       (1 << eHeaderContentRange);
+}
+
+bool HttpStream::matchHeaderName(char c)
+{
+    if (c == ':')
+    {
+        // We've reached the end of the name, see if it was the whole of one
+        // of the names we're after
+        for (iHeaderIndex = 0; (iHeaderMatches >> iHeaderIndex) != 0; iHeaderIndex++)
+        {
+            if ((iHeaderMatches & (1 << iHeaderIndex)) &&
+                (iHeaderNames[iHeaderIndex][iHeaderNameIndex] == '\0'))
             {
-                iState = eReadingChunkLength;
+                iHeaderValueLength = 0;
+                if (iHeaderValues[iHeaderIndex])
+                {
+                    iHeaderValues[iHeaderIndex][0] = '\0';
+                }
+                if (cacheValidator(iHeaderIndex))
+                {
+                    cacheValidator(iHeaderIndex)[0] = '\0';
+                }
+                if (iHeaderIndex == eHeaderContentLength)
+                {
+                    // Just in case we get multiple Content-Length headers,
+                    // this will ensure we just get the value of the last one
+                    iContentLength = 0;
+                    iBodyLengthConsumed = 0;
+                }
+                else if (iHeaderIndex == eHeaderTransferEncoding)
+                {
+                    iTransferEncodingChunkedPtr = HTTP_HEADER_VALUE_CHUNKED;
+                }
+                else if (iHeaderIndex == eHeaderContentEncoding)
+                {
+                    iContentCodingLength = 0;
+                }
+                else if (iHeaderIndex == eHeaderConnection)
+                {
+                    iConnectionClosePtr = kConnectionClose;
+                }
+                else if (iHeaderIndex == eHeaderContentRange)
+                {
+                    iContentRangeStart = -1;
+                    iContentRangeTotal = -1;
+                    iContentRangePart = 0;
+                }
+                return true;
             }
         }
+        // None of them
+        return false;
     }
-    return ret;
+
+    // Drop any of the names that this character doesn't match.  That includes
+    // names which have already ended, as their '\0' won't match
+    c = tolower(c);
+    for (uint8_t i = 0; (iHeaderMatches >> i) != 0; i++)
+    {
+        if ((iHeaderMatches & (1 << i)) &&
+            (tolower(iHeaderNames[i][iHeaderNameIndex]) != c))
+        {
+            iHeaderMatches &= ~(1 << i);
+        }
+    }
+    iHeaderNameIndex++;
+
+    return (iHeaderMatches != 0);
 }
 
-bool HttpStream::headerAvailable()
+void HttpStream::processHeaderValue(char c)
 {
-    // clear the currently store header line
-    iHeaderLine = "";
+    // The cache might want its own copy of the value
+    char* const values[] = { iHeaderValues[iHeaderIndex], cacheValidator(iHeaderIndex) };
+    const size_t sizes[] = { iHeaderValueSizes[iHeaderIndex], HTTP_CACHE_VALIDATOR_SIZE };
 
-    while (!endOfHeadersReached())
+    if ((c == '\r') || (c == '\n'))
     {
-        // read a byte from the header
-        int c = readHeader();
+        if (iHeaderIndex == eHeaderContentEncoding)
+        {
+            endContentCoding();
+        }
+        // End of the line, trim any trailing whitespace from what we stored
+        for (int i = 0; i < 2; i++)
+        {
+            if (values[i])
+            {
+                char* value = values[i];
+                size_t length = strlen(value);
 
-        if (c == '\r' || c == '\n')
+                while ((length > 0) && isSpace(value[length-1]))
+                {
+                    value[--length] = '\0';
+                }
+            }
+        }
+        return;
+    }
+
+    if ((iHeaderValueLength == 0) && isSpace(c))
+    {
+        // Skip any leading whitespace
+        return;
+    }
+
+    switch(iHeaderIndex)
+    {
+    case eHeaderContentLength:
+        if (isdigit(c) && !appendDigit(iContentLength, 10, c - '0'))
         {
-            if (iHeaderLine.length())
+            iInvalidLength = true;
+        }
+        break;
+    case eHeaderTransferEncoding:
+        // Look for "chunked" anywhere in the list of encodings
+        if (matchToken(iTransferEncodingChunkedPtr, HTTP_HEADER_VALUE_CHUNKED, c))
+        {
+            iIsChunked = true;
+        }
+        break;
+    case eHeaderContentEncoding:
+        // Collect each coding in the list, lower case, to check once we've
+        // got all of it
+        if (c == ',')
+        {
+            endContentCoding();
+        }
+        else if (!isSpace(c))
+        {
+            if (iContentCodingLength < sizeof(iContentCodingName) - 1)
             {
-                // end of the line, all done
-                break;
-            } 
-            else
+                iContentCodingName[iContentCodingLength] = tolower(c);
+            }
+            // Keep counting past the end of iContentCodingName, so that
+            // longer names don't match
+            if (iContentCodingLength < 0xff)
             {
-                // ignore any CR or LF characters
-                continue;
+                iContentCodingLength++;
             }
         }
+        break;
+    case eHeaderConnection:
+        // Look for "close" anywhere in the list of options
+        if (matchToken(iConnectionClosePtr, kConnectionClose, c))
+        {
+            iConnectionClose = true;
+        }
+        break;
+    case eHeaderContentRange:
+        // "bytes first-last/total", or "bytes */total" if the range
+        // couldn't be satisfied
+        if (isdigit(c) && ((iContentRangePart == 1) || (iContentRangePart == 3)))
+        {
+            tHttpLength& value = (iContentRangePart == 1) ? iContentRangeStart : iContentRangeTotal;
 
-        // append byte to header line
-        iHeaderLine += (char)c;
+            if (value < 0)
+            {
+                value = 0;
+            }
+            if (!appendDigit(value, 10, c - '0'))
+            {
+                iInvalidLength = true;
+            }
+        }
+        else if (((c == ' ') && (iContentRangePart == 0)) ||
+                 ((c == '-') && (iContentRangePart == 1)) || (c == '/'))
+        {
+            // On to the next part
+            iContentRangePart = (c == '/') ? 3 : iContentRangePart + 1;
+        }
+        break;
+    default:
+        break;
+    };
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (values[i] && (iHeaderValueLength < sizes[i] - 1))
+        {
+            values[i][iHeaderValueLength] = c;
+            values[i][iHeaderValueLength+1] = '\0';
+        }
     }
+    iHeaderValueLength++;
+}
 
-    return (iHeaderLine.length() > 0);
+void HttpStream::endContentCoding()
+{
+    if (iContentCodingLength == 0)
+    {
+        // Empty entry in the list
+        return;
+    }
+
+    tContentCoding coding = eCodingUnsupported;
+
+    if (iContentCodingLength < sizeof(iContentCodingName))
+    {
+        iContentCodingName[iContentCodingLength] = '\0';
+        if (!strcmp(iContentCodingName, "identity"))
+        {
+            coding = eCodingIdentity;
+        }
+        else if (!strcmp(iContentCodingName, "gzip") || !strcmp(iContentCodingName, "x-gzip"))
+        {
+            coding = eCodingGzip;
+        }
+        else if (!strcmp(iContentCodingName, "deflate"))
+        {
+            coding = eCodingDeflate;
+        }
+    }
+    iContentCodingLength = 0;
+
+    if (coding == eCodingIdentity)
+    {
+        // It makes no difference
+    }
+    else if (iContentCoding == eCodingIdentity)
+    {
+        iContentCoding = coding;
+    }
+    else
+    {
+        // We can only undo a single coding
+        iContentCoding = eCodingUnsupported;
+    }
 }
 
-String HttpStream::readHeaderName()
+bool HttpStream::matchToken(const char*& aPosition, const char* aToken, char c)
 {
-    int colonIndex = iHeaderLine.indexOf(':');
+    c = tolower(c);
+    if (c != *aPosition)
+    {
+        // The match so far has failed, but this could still start a new one
+        aPosition = aToken;
+        if (c != *aPosition)
+        {
+            return false;
+        }
+    }
 
-    if (colonIndex == -1)
+    aPosition++;
+    if (*aPosition == '\0')
     {
-        return "";
+        aPosition = aToken;
+        return true;
     }
+    return false;
+}
 
-    return iHeaderLine.substring(0, colonIndex);
+bool HttpStream::appendDigit(tHttpLength& aValue, uint8_t aBase, uint8_t aDigit)
+{
+    if (aValue > (HTTP_LENGTH_MAX - aDigit) / aBase)
+    {
+        return false;
+    }
+    aValue = (aValue * aBase) + aDigit;
+    return true;
 }
 
-String HttpStream::readHeaderValue()
+void HttpStream::startDecoding()
 {
-    int colonIndex = iHeaderLine.indexOf(':');
-    int startIndex = colonIndex + 1;
+    // Only if we asked for it, and there's a body to decompress
+    iDecoding = iInflater &&
+                ((iContentCoding == eCodingGzip) || (iContentCoding == eCodingDeflate)) &&
+                (iContentLength != 0) && (iStatusCode != 204) && (iStatusCode != 304);
 
-    if (colonIndex == -1)
+    if (iDecoding)
     {
-        return "";
+        iInflater->begin((iContentCoding == eCodingGzip) ? Inflater::eFormatGzip : Inflater::eFormatDeflate,
+                         fillInflater, this);
     }
+}
 
-    // trim any leading whitespace
-    while (startIndex < (int)iHeaderLine.length() && isSpace(iHeaderLine[startIndex]))
+void HttpStream::cacheStatusRead()
+{
+    if ((iCacheState != eCacheMiss) && (iCacheState != eCacheHit))
     {
-        startIndex++;
+        return;
     }
 
-    return iHeaderLine.substring(startIndex);
+    if (iStatusCode == 200)
+    {
+        // Whatever we had is out of date, collect the new validators from
+        // the headers
+        iCache->iETag[0] = '\0';
+        iCache->iLastModified[0] = '\0';
+        iCacheState = eCacheFetching;
+    }
+    else if ((iStatusCode == 304) && (iCacheState == eCacheHit))
+    {
+        iCacheState = eCacheNotModified;
+    }
+    else
+    {
+        iCacheState = eCacheUnused;
+    }
+}
+
+void HttpStream::startCaching()
+{
+    if (iCacheState == eCacheFetching)
+    {
+        // A validator that didn't fit might not match next time, and without
+        // one there's no way to ask whether it has changed
+        for (int i = 0; i < 2; i++)
+        {
+            char* validator = i ? iCache->iLastModified : iCache->iETag;
+
+            if (strlen(validator) == HTTP_CACHE_VALIDATOR_SIZE - 1)
+            {
+                validator[0] = '\0';
+            }
+        }
+
+        long length = (iDecoding || iIsChunked || (iContentLength > LONG_MAX)) ? -1 : (long)iContentLength;
+        bool store = (iCache->etag()[0] || iCache->lastModified()[0]) && iCache->beginStore(length);
+
+        iCacheState = store ? eCacheStoring : eCacheUnused;
+        if (store && endOfBodyReached())
+        {
+            // There's no body to wait for
+            endCaching(true);
+        }
+    }
+    else if (iCacheState == eCacheNotModified)
+    {
+        if (iCache->beginRead())
+        {
+            // Read it from the cache as if it had been sent again
+            iCacheState = eCacheServing;
+            iContentLength = iCache->available();
+            iBodyLengthConsumed = 0;
+        }
+        else
+        {
+            iCacheState = eCacheUnused;
+        }
+    }
+}
+
+void HttpStream::endCaching(bool aComplete)
+{
+    iCache->endStore(aComplete);
+    iCacheState = eCacheUnused;
+}
+
+char* HttpStream::cacheValidator(uint8_t aIndex)
+{
+    if (iCacheState != eCacheFetching)
+    {
+        return NULL;
+    }
+    else if (aIndex == eHeaderETag)
+    {
+        return iCache->iETag;
+    }
+    else if (aIndex == eHeaderLastModified)
+    {
+        return iCache->iLastModified;
+    }
+    return NULL;
 }
 
 int HttpStream::readHeader()
@@ -670,78 +2253,74 @@ int HttpStream::readHeader()
         // act as a slightly less efficient version of read()
         return c;
     }
+    iStats.headerBytes++;
 
     // Whilst reading out the headers to whoever wants them, we'll keep an
-    // eye out for the "Content-Length" header
+    // eye out for the headers we're interested in
     switch(iState)
     {
     case eStatusCodeRead:
-        // We're at the start of a line, or somewhere in the middle of reading
-        // the Content-Length prefix
-        if (*iContentLengthPtr == c)
-        {
-            // This character matches, just move along
-            iContentLengthPtr++;
-            if (*iContentLengthPtr == '\0')
-            {
-                // We've reached the end of the prefix
-                iState = eReadingContentLength;
-                // Just in case we get multiple Content-Length headers, this
-                // will ensure we just get the value of the last one
-                iContentLength = 0;
-                iBodyLengthConsumed = 0;
-            }
-        }
-        else if (*iTransferEncodingChunkedPtr == c)
-        {
-            // This character matches, just move along
-            iTransferEncodingChunkedPtr++;
-            if (*iTransferEncodingChunkedPtr == '\0')
-            {
-                // We've reached the end of the Transfer Encoding: chunked header
-                iIsChunked = true;
-                iState = eSkipToEndOfHeader;
-            }
-        }
-        else if (((iContentLengthPtr == kContentLengthPrefix) && (iTransferEncodingChunkedPtr == kTransferEncodingChunked)) && (c == '\r'))
+        // We're at the start of a line
+        if (c == '\r')
         {
             // We've found a '\r' at the start of a line, so this is probably
             // the end of the headers
-            iState = eLineStartingCRFound;
-        }
-        else
-        {
-            // This isn't the Content-Length or Transfer Encoding chunked header, skip to the end of the line
-            iState = eSkipToEndOfHeader;
-        }
-        break;
-    case eReadingContentLength:
-        if (isdigit(c))
-        {
-            iContentLength = iContentLength*10 + (c - '0');
+            setState(eLineStartingCRFound);
+            break;
         }
-        else
+        else if (c != '\n')
         {
-            // We've reached the end of the content length
-            // We could sanity check it here or double-check for "\r\n"
-            // rather than anything else, but let's be lenient
-            iState = eSkipToEndOfHeader;
+            // Check this header's name against all the ones we're after
+            iHeaderMatches = iHeaderWatchMask;
+            if (iCacheState == eCacheFetching)
+            {
+                iHeaderMatches |= (1 << eHeaderETag) | (1 << eHeaderLastModified);
+            }
+            iHeaderNameIndex = 0;
+            setState(matchHeaderName(c) ? eReadingHeaderName : eSkipToEndOfHeader);
+            break;
         }
-        break;
+        // else a bare '\n' on its own also ends the headers, so
+        // fall through
     case eLineStartingCRFound:
         if (c == '\n')
         {
+            if ((iStatusCode == 204) || (iStatusCode == 304))
+            {
+                // These never have a body, whatever the headers say
+                iContentLength = 0;
+                iIsChunked = false;
+            }
+
             if (iIsChunked)
             {
-                iState = eReadingChunkLength;
+                setState(eReadingChunkLength);
                 iChunkLength = 0;
             }
             else
             {
-                iState = eReadingBody;
+                setState(eReadingBody);
             }
+            iStats.headersTime = sinceRequestStart();
+            startDecoding();
+            startCaching();
+        }
+        break;
+    case eReadingHeaderName:
+        if (!matchHeaderName(c))
+        {
+            // This isn't a header we're interested in, skip to the end of
+            // the line
+            setState(eSkipToEndOfHeader);
+        }
+        else if (c == ':')
+        {
+            setState(eReadingHeaderValue);
         }
         break;
+    case eReadingHeaderValue:
+        processHeaderValue(c);
+        break;
     default:
         // We're just waiting for the end of the line now
         break;
@@ -750,13 +2329,8 @@ int HttpStream::readHeader()
     if ( (c == '\n') && !endOfHeadersReached() )
     {
         // We've got to the end of this line, start processing again
-        iState = eStatusCodeRead;
-        iContentLengthPtr = kContentLengthPrefix;
-        iTransferEncodingChunkedPtr = kTransferEncodingChunked;
+        setState(eStatusCodeRead);
     }
     // And return the character read to whoever wants it
     return c;
 }
-
-
-
@@ -8,6 +8,10 @@
 #include <Arduino.h>
 #include <IPAddress.h>
 #include "Stream.h"
+#include "Inflater.h"
+#include "Deflater.h"
+#include "HttpClock.h"
+#include "HttpCache.h"
 
 static const int HTTP_SUCCESS =0;
 // The end of the headers has been reached.  This consumes the '\n'
@@ -22,6 +26,26 @@ static const int HTTP_ERROR_TIMED_OUT =-3;
 // The response from the server is invalid, is it definitely an HTTP
 // server?
 static const int HTTP_ERROR_INVALID_RESPONSE =-4;
+// A response header was longer than the buffer given to readHeaders()
+static const int HTTP_ERROR_HEADER_TOO_LONG =-5;
+// The connection can't be used for another request, so it should be closed
+// and opened again
+static const int HTTP_ERROR_CONNECTION_CLOSE =-6;
+// Couldn't pass on all of the response body, e.g. the file it was being
+// copied to is full
+static const int HTTP_ERROR_WRITE_FAILED =-7;
+// The resource changed part way through a download, so it has to start again
+// from the beginning
+static const int HTTP_ERROR_CONTENT_CHANGED =-8;
+
+// Values returned by HttpStream::poll() to show how far through the response
+// it has got.  Errors are reported with the HTTP_ERROR_* codes above
+// Still waiting for the rest of the status line or headers
+static const int HTTP_POLL_IN_PROGRESS =1;
+// The status line has been read, responseStatusCode() will return at once
+static const int HTTP_POLL_STATUS_READY =2;
+// All of the headers have been read, the body is ready to be read
+static const int HTTP_POLL_HEADERS_DONE =3;
 
 // Define some of the common methods and headers here
 // That lets other code reuse them without having to declare another copy
@@ -36,12 +60,200 @@ static const int HTTP_ERROR_INVALID_RESPONSE =-4;
 #define HTTP_HEADER_CONNECTION     "Connection"
 #define HTTP_HEADER_TRANSFER_ENCODING "Transfer-Encoding"
 #define HTTP_HEADER_USER_AGENT     "User-Agent"
+#define HTTP_HEADER_CONTENT_ENCODING "Content-Encoding"
+#define HTTP_HEADER_ACCEPT_ENCODING "Accept-Encoding"
+#define HTTP_HEADER_ETAG           "ETag"
+#define HTTP_HEADER_LOCATION       "Location"
+#define HTTP_HEADER_LAST_MODIFIED  "Last-Modified"
+#define HTTP_HEADER_CONTENT_RANGE  "Content-Range"
+#define HTTP_HEADER_RANGE          "Range"
+#define HTTP_HEADER_IF_RANGE       "If-Range"
+#define HTTP_HEADER_IF_NONE_MATCH  "If-None-Match"
+#define HTTP_HEADER_IF_MODIFIED_SINCE "If-Modified-Since"
 #define HTTP_HEADER_VALUE_CHUNKED  "chunked"
 
+// Size of the buffer used to collect the request line and headers, so that
+// they can be sent with a single write to the underlying stream,
+// and for collecting a chunked request body into chunks
+#ifndef HTTP_TX_BUFFER_SIZE
+#define HTTP_TX_BUFFER_SIZE 128
+#endif
+#if (HTTP_TX_BUFFER_SIZE < 16) || (HTTP_TX_BUFFER_SIZE > 0xffff)
+#error "HTTP_TX_BUFFER_SIZE must be between 16 and 65535"
+#endif
+
+// Size of the blocks used when copying or skipping the response body
+#ifndef HTTP_RX_BLOCK_SIZE
+#define HTTP_RX_BLOCK_SIZE 64
+#endif
+
+// Milliseconds that the blocking calls, such as responseStatusCode(), pause
+// for each time there's no data yet.  Short, so a response is noticed soon
+// after it arrives; the overall limit is still setHttpResponseTimeout()
+#ifndef HTTP_WAIT_FOR_DATA_DELAY
+#define HTTP_WAIT_FOR_DATA_DELAY 5
+#endif
+
+// Number of extra response headers that can be registered with
+// HttpStream::captureHeader(), on top of the ones it already knows about
+#ifndef HTTP_MAX_CAPTURED_HEADERS
+#define HTTP_MAX_CAPTURED_HEADERS 4
+#endif
+#if HTTP_MAX_CAPTURED_HEADERS > 8
+#error "HTTP_MAX_CAPTURED_HEADERS can't be more than 8"
+#endif
+
+// Space for each of the ETag and Last-Modified values kept by HttpDownload
+#ifndef HTTP_DOWNLOAD_VALIDATOR_SIZE
+#define HTTP_DOWNLOAD_VALIDATOR_SIZE 48
+#endif
+
+// Lengths of, and positions in, response bodies and chunks.  64 bits, so
+// that bodies over 2GB can be streamed through on hosts, except on AVR where
+// the arithmetic would cost too much for bodies that could never be that big
+#if defined(__AVR__)
+typedef int32_t tHttpLength;
+#define HTTP_LENGTH_MAX INT32_MAX
+#else
+typedef int64_t tHttpLength;
+#define HTTP_LENGTH_MAX INT64_MAX
+#endif
+
+// Timings and counters for the current request, from HttpStream::stats().
+// They're cleared by resetState(), which happens when a new request is
+// started once the last response has been read.  Times are in milliseconds
+// since the request was started, and stay 0 until that point is reached
+struct HttpStats
+{
+    // Time from the HttpStream's clock when the request was started
+    unsigned long requestStart;
+    // Bytes of the request sent to the stream, and how many writes it took
+    unsigned long requestBytes;
+    unsigned long writeCalls;
+    // When the first byte of the response arrived
+    unsigned long firstByteTime;
+    // When the status line had been read
+    unsigned long statusTime;
+    // When all of the headers had been read
+    unsigned long headersTime;
+    // Bytes of the status line and headers
+    unsigned long headerBytes;
+    // Bytes of the response read from the stream so far, including any
+    // chunk framing and before any decompression
+    unsigned long responseBytes;
+    // Bytes of the body read so far, after any decompression, and when the
+    // latest of them was read
+    unsigned long bodyBytes;
+    unsigned long bodyTime;
+    // Number of times we found no data and had to wait for some
+    unsigned long waits;
+
+    /** Return the rate the body has been read at since the end of the
+      headers, in bytes per second, or 0 if it can't be worked out yet
+    */
+    unsigned long bodyRate() const
+    {
+        unsigned long elapsed = bodyTime - headersTime;
+        return (bodyBytes && elapsed) ? (unsigned long)((bodyBytes * 1000ULL) / elapsed) : 0;
+    };
+};
+
+// Query string for a request, see HttpForm.h
+class HttpForm;
+
+// Progress of a download with HttpStream::download(), so that it can carry
+// on from where it got to if the connection drops
+class HttpDownload
+{
+public:
+    HttpDownload() { reset(); };
+
+    /** Forget about any progress, so the next download starts from the
+      beginning
+    */
+    void reset() { iOffset = 0; iETag[0] = '\0'; iLastModified[0] = '\0'; };
+
+    /** Return the number of bytes written to the output so far
+    */
+    tHttpLength offset() { return iOffset; };
+
+protected:
+    friend class HttpStream;
+
+    // Number of bytes written to the output so far
+    tHttpLength iOffset;
+    // Validators from the server, to make sure we carry on with the same
+    // version of the resource
+    char iETag[HTTP_DOWNLOAD_VALIDATOR_SIZE];
+    char iLastModified[HTTP_DOWNLOAD_VALIDATOR_SIZE];
+};
+
 class HttpStream : public Stream
 {
 public:
     static const int kNoContentLengthHeader =-1;
+    // skipResponseBody() won't read more than this by default, it is
+    // quicker to reconnect than to wait for a longer body to arrive
+    static const long kMaxDrainLength =1024;
+
+    /** Called by readHeaders() for each response header.  The name and value
+      point into the buffer given to readHeaders() and are NOT NUL-terminated,
+      so copy out anything you need to keep before returning.
+    */
+    typedef void (*tHeaderCallback)(const char* aName, size_t aNameLength,
+                                    const char* aValue, size_t aValueLength,
+                                    void* aContext);
+
+    /** Called as the response body is read with readBytes(), responseBody()
+      etc., with the stats so far, e.g. to show progress or pass them on to
+      some monitoring.
+    */
+    typedef void (*tProgressCallback)(const HttpStats& aStats, void* aContext);
+
+    // What readHeaders() should do with a header line too long for its buffer
+    typedef enum {
+        // Pass on as much of the line as fits in the buffer
+        eHeaderTruncate,
+        // Leave that header out
+        eHeaderSkip,
+        // Stop reading and return HTTP_ERROR_HEADER_TOO_LONG
+        eHeaderFail
+    } tHeaderOverflow;
+
+    // States the response parser goes through, in order.  Everything from
+    // eReadingBody on is part of the body
+    typedef enum {
+        eIdle,
+        eRequestStarted,
+        eRequestSent,
+        eReadingStatusCode,
+        eSkipToEndOfStatusLine,
+        eStatusCodeRead,
+        eReadingHeaderName,
+        eReadingHeaderValue,
+        eSkipToEndOfHeader,
+        eLineStartingCRFound,
+        eReadingBody,
+        eReadingChunkLength,
+        eReadingChunkExtension,
+        eReadingBodyChunk,
+        eReadingChunkEnd,
+        eReadingTrailer,
+        eReadingTrailerName,
+        eReadingTrailerValue,
+        eSkipToEndOfTrailer,
+        eEndOfChunkedBody
+    } tHttpState;
+
+    /** Called on each change of state when HTTP_STATE_TRACE is defined
+      @param aOldState  State it was in
+      @param aNewState  State it's now in
+      @param aTime      Time from the clock when it changed
+      @param aOffset    Number of bytes of the response read when it changed
+    */
+    typedef void (*tStateTraceCallback)(tHttpState aOldState, tHttpState aNewState,
+                                        unsigned long aTime, unsigned long aOffset,
+                                        void* aContext);
 
 // FIXME Write longer API request, using port and user-agent, example
 // FIXME Update tempToPachube example to calculate Content-Length correctly
@@ -57,6 +269,7 @@ public:
     /** End a more complex request.
         Use this when you need to have sent additional headers in the request,
         but you will also need to call beginRequest() at the start.
+        If the body is being sent chunked this also sends the last chunk.
     */
     void endRequest();
 
@@ -64,8 +277,14 @@ public:
         Use this when you need to send the body after additional headers
         in the request, but can optionally call endRequest() when
         you are finished.
+      @param aChunked  Send the body with "Transfer-Encoding: chunked", for
+                       when you don't know how long it will be.  Whatever is
+                       written is collected and sent a chunk at a time, and
+                       you MUST call endRequest() when you are finished.
+                       Only takes effect if the headers haven't been finished
+                       already
     */
-    void beginBody();
+    void beginBody(bool aChunked = false);
 
     /** Connect to the server and start to send a GET request.
       @param aURLPath     Url to request
@@ -74,6 +293,16 @@ public:
     int get(const char* aURLPath);
     int get(const String& aURLPath);
 
+    /** Connect to the server and start to send a GET request, with aQuery
+      URL-encoded and added to aURLPath as "?name=value&name2=value2".  It's
+      written straight into the request line, so no String is built for it.
+      Responses to requests with a query aren't cached.
+      @param aURLPath     Url to request, without a query
+      @param aQuery       Fields for the query string
+      @return 0 if successful, else error
+    */
+    int get(const char* aURLPath, HttpForm& aQuery);
+
     /** Connect to the server and start to send a POST request.
       @param aURLPath     Url to request
       @return 0 if successful, else error
@@ -161,6 +390,16 @@ public:
                      int aContentLength = -1,
                      const byte aBody[] = NULL);
 
+    /** Connect to the server and start to send the request, with aQuery
+      added to aURLPath as a query string, as for get()
+      @param aURLPath        Url to request, without a query
+      @param aQuery          Fields for the query string
+      @param aHttpMethod     Type of HTTP request to make
+      @return 0 if successful, else error
+    */
+    int startRequest(const char* aURLPath, HttpForm& aQuery,
+                     const char* aHttpMethod = HTTP_METHOD_GET);
+
     /** Send an additional header line.  This can only be called in between the
       calls to beginRequest and endRequest.
       @param aHeader Header line to send, in its entirety (but without the
@@ -196,6 +435,13 @@ public:
     void sendHeader(const String& aHeaderName, const int aHeaderValue)
       { sendHeader(aHeaderName.c_str(), aHeaderValue); }
 
+    /** Send a header whose value is a length, such as Content-Length, which
+      unlike sendHeader(const char*, const int) can be bigger than an int
+      @param aHeaderName Type of header being sent
+      @param aLength Value for that header
+    */
+    void sendLengthHeader(const char* aHeaderName, tHttpLength aLength);
+
     /** Send a basic authentication header.  This will encode the given username
       and password, and send them in suitable header line for doing Basic
       Authentication.
@@ -212,6 +458,18 @@ public:
     */
     int responseStatusCode();
 
+    /** Process as much of the response as has already arrived, without
+      waiting for any more.  Use this instead of responseStatusCode() and
+      skipResponseHeaders() to keep the rest of your sketch running whilst the
+      response is on its way.  Stops once the status line has been read, so
+      that the headers can still be read with headerAvailable() etc. if you
+      want them, and carries on through the headers on the next call.
+      @return HTTP_POLL_IN_PROGRESS if more data is needed,
+      HTTP_POLL_STATUS_READY when the status line has just been read,
+      HTTP_POLL_HEADERS_DONE once the body is ready to be read, else an error
+    */
+    int poll();
+
     /** Check if a header is available to be read.
       Use readHeaderName() to read header name, and readHeaderValue() to
       read the header value
@@ -229,6 +487,43 @@ public:
     */
     String readHeaderValue();
 
+    /** Read all of the response headers, passing each of them to aCallback.
+      Each line is parsed in aBuffer, so no memory is allocated whilst
+      reading the headers.  This is an alternative to headerAvailable() with
+      readHeaderName() and readHeaderValue().
+      MUST be called after responseStatusCode() and before contentLength()
+      @param aBuffer    Space to hold one header line
+      @param aBufferSize  Size of aBuffer, i.e. the longest line we'll handle
+      @param aCallback  Function to call with each header
+      @param aContext   Passed on to aCallback
+      @param aOverflow  What to do with lines longer than aBufferSize
+      @return HTTP_SUCCESS if successful, else an error code
+    */
+    int readHeaders(char* aBuffer, size_t aBufferSize,
+                    tHeaderCallback aCallback, void* aContext = NULL,
+                    tHeaderOverflow aOverflow = eHeaderTruncate);
+
+    /** Copy the value of a response header into aBuffer as the headers are
+      read, however they end up being read (responseStatusCode(),
+      skipResponseHeaders(), poll(), etc.).  Header names are matched
+      ignoring case, and headers nobody has asked for are skipped without
+      being stored anywhere.  Headers in the trailer of a chunked body are
+      captured too, once the end of the body has been reached.
+      The value is NUL-terminated and truncated to fit aBuffer.  aBuffer is
+      emptied when each request is sent, so it will be "" if the header isn't
+      in the response.
+      @param aName        Name of the header, e.g. HTTP_HEADER_ETAG
+      @param aBuffer      Where to store the value
+      @param aBufferSize  Size of aBuffer, including space for the '\0'
+      @return true if the header will be captured, false if there is no
+      room to register any more headers
+    */
+    bool captureHeader(const char* aName, char* aBuffer, size_t aBufferSize);
+
+    /** Stop capturing all the headers set up with captureHeader()
+    */
+    void clearCapturedHeaders();
+
     /** Read the next character of the response headers.
       This functions in the same way as read() but to be used when reading
       through the headers.  Check whether or not the end of the headers has
@@ -255,20 +550,89 @@ public:
     bool endOfHeadersReached();
 
     /** Test whether the end of the body has been reached.
-      Only works if the Content-Length header was returned by the server
+      Only works if the Content-Length header was returned by the server, or
+      the body is chunked
       @return true if we are now at the end of the body, else false
     */
     bool endOfBodyReached();
     virtual bool endOfStream() { return endOfBodyReached(); };
     virtual bool completed() { return endOfBodyReached(); };
 
+    /** Check whether the connection can be used for another request once the
+      rest of this response has been read.  That's the case unless the server
+      sent "Connection: close" or didn't tell us how long the body is.
+      Also skips response headers if they have not been read already
+      @return true if the connection can be reused, else false
+    */
+    bool canReuseConnection();
+
+    /** Read and throw away the rest of the response, so that the connection
+      is ready for the next request.  This is done for you when the next
+      request is started.
+      Also skips response headers if they have not been read already
+      @param aMaxLength  Give up rather than read more than this many bytes
+      @return HTTP_SUCCESS if the connection is ready for the next request,
+      HTTP_ERROR_CONNECTION_CLOSE if it should be closed and opened again,
+      else an error
+    */
+    int skipResponseBody(long aMaxLength = kMaxDrainLength);
+
+    /** Allow more requests to be sent before the response to the first one
+      has been read, so that they can all be on their way to the server
+      together.  The responses then have to be read in the same order, moving
+      from one to the next with nextResponse().  All of the requests MUST be
+      sent before reading the first response, and the server must say how
+      long each response is.
+      @param aPipelining  true to allow pipelined requests
+    */
+    void setPipelining(bool aPipelining) { iPipelining = aPipelining; };
+
+    /** Return the number of pipelined responses still to come after the
+      current one
+    */
+    int pendingResponses() { return iQueuedResponses; };
+
+    /** Finish with the current response, skipping whatever is left of it,
+      and get ready to read the response to the next pipelined request with
+      responseStatusCode() etc.
+      @return HTTP_SUCCESS if successful, else an error
+    */
+    int nextResponse();
+
+    /** Ask for response bodies to be compressed, and decompress them with
+      aInflater as they are read.  An Accept-Encoding header is sent with each
+      request, and if the server uses gzip or deflate the body is decompressed
+      by read(), readBytes(), responseBody() etc. without being stored
+      anywhere else.  Bodies the server hasn't compressed are read as normal.
+      @param aInflater  Inflater to use, or NULL to stop asking for
+                        compressed bodies
+    */
+    void setInflater(Inflater* aInflater) { iInflater = aInflater; };
+
+    /** Test whether the response body is being decompressed
+    */
+    bool isResponseCompressed() { return iDecoding; };
+
+    /** Compress request bodies with aDeflater, sending them with
+      "Content-Encoding: deflate".  This applies to bodies passed to
+      post(), put() etc., which are sent with the compressed Content-Length,
+      and to bodies written after beginBody(true).  Bodies written without
+      chunking aren't compressed, as their length has to be known before
+      they're sent; use Deflater::compressedLength() for those if need be.
+      The server has to accept compressed request bodies, and have the same
+      dictionary if aDeflater is using one.
+      @param aDeflater  Deflater to use, or NULL to send bodies as they are
+    */
+    void setDeflater(Deflater* aDeflater) { iDeflater = aDeflater; };
+
     /** Return the length of the body.
       Also skips response headers if they have not been read already
       MUST be called after responseStatusCode()
       @return Length of the body, in bytes, or kNoContentLengthHeader if no
-      Content-Length header was returned by the server
+      Content-Length header was returned by the server.  If the body is
+      compressed this is the compressed length
     */
-    int contentLength();
+    tHttpLength contentLength();
 
     /** Returns if the response body is chunked
       @return true if response body is chunked, false otherwise
@@ -282,6 +646,104 @@ public:
     */
     String responseBody();
 
+    /** Read the response body into aBuffer, in blocks rather than a byte at
+      a time.  If the body doesn't fit, the rest of it can still be read with
+      read() etc.
+      Also skips response headers if they have not been read already
+      MUST be called after responseStatusCode()
+      @param aBuffer  Where to put the body
+      @param aSize    Size of aBuffer
+      @return Number of bytes put in aBuffer, or an error if the body
+      stopped arriving before the end
+    */
+    int responseBody(uint8_t* aBuffer, size_t aSize);
+
+    /** Copy the response body to aOutput, e.g. a file or another stream,
+      in blocks rather than a byte at a time, without needing space for all
+      of it.  Nothing is buffered beyond a block, so this is the way to read
+      bodies too big to hold, even ones of many gigabytes on a host.
+      Also skips response headers if they have not been read already
+      MUST be called after responseStatusCode()
+      @param aOutput  Where to send the body
+      @return Number of bytes copied, or an error if the body stopped
+      arriving before the end or aOutput wouldn't take all of it
+    */
+    tHttpLength responseBody(Print& aOutput);
+
+    /** Download aURLPath to aOutput, carrying on from where aDownload got to
+      if an earlier attempt was interrupted.  Only the rest of the resource is
+      asked for, with a Range header, as long as it hasn't changed since the
+      last attempt.  If the server ignores the Range the part we already have
+      is skipped over.
+      Call this again, after reconnecting if need be, when it fails with
+      HTTP_ERROR_TIMED_OUT etc.  If it fails with HTTP_ERROR_CONTENT_CHANGED
+      throw away what's been written to aOutput so far before calling it
+      again, aDownload will have been reset so it starts from the beginning.
+      Response bodies aren't decompressed, even if setInflater() has been
+      called, as the ranges refer to the compressed data.
+      @param aURLPath   Url to download
+      @param aOutput    Where to send the body
+      @param aDownload  Progress of the download, updated as it goes
+      @return HTTP_SUCCESS once the whole body has been written to aOutput,
+      the status code if the server responds with something other than
+      the body, else an error
+    */
+    int download(const char* aURLPath, Print& aOutput, HttpDownload& aDownload);
+
+    /** Keep the responses to GET requests in aCache, and only download them
+      again if they've changed.  get() sends If-None-Match and
+      If-Modified-Since with the validators of any response cached for the
+      path.  If the server replies "304 Not Modified" the status code is
+      still 304, so you can tell nothing has changed, but the cached body
+      can be read with read(), responseBody() etc. just as if it had been
+      sent again.  A "200 OK" response with an ETag or Last-Modified header
+      is stored in aCache as its body is read, and is only kept if all of it
+      is read.
+      Pipelined requests and download() don't use the cache.
+      @param aCache  Cache to use, or NULL to stop caching
+    */
+    void setCache(HttpCache* aCache) { iCache = aCache; };
+
+    /** Test whether the response body is being read from the cache
+    */
+    bool isResponseCached() { return (iCacheState == eCacheServing); };
+
+    /** Return the timings and counters for the current request, to see
+      where the time goes: sending the request, waiting for the server,
+      reading the headers or reading the body
+    */
+    const HttpStats& stats() { return iStats; };
+
+    /** Call aCallback each time some of the response body is read with
+      readBytes(), or by responseBody(), download() etc. which use it.
+      It's called often, so it should return quickly.
+      @param aCallback  Function to call, or NULL for none
+      @param aContext   Passed on to aCallback
+    */
+    void setProgressCallback(tProgressCallback aCallback, void* aContext = NULL)
+      { iProgressCallback = aCallback; iProgressContext = aContext; };
+
+#ifdef HTTP_STATE_TRACE
+    /** Call aCallback every time the state of the request and response
+      changes, e.g. to record a timeline of where a slow request spent its
+      time.  It's called from deep inside the parser, so it should just note
+      down what it's given and return.  Only available when HTTP_STATE_TRACE
+      is defined, otherwise there's no cost to any of this.
+      @param aCallback  Function to call, or NULL for none
+      @param aContext   Passed on to aCallback
+    */
+    void setStateTrace(tStateTraceCallback aCallback, void* aContext = NULL)
+      { iStateTraceCallback = aCallback; iStateTraceContext = aContext; };
+#endif
+
+    /** Use aClock to tell the time and to wait whilst there's no data,
+      instead of millis() and delay().  For example HttpYieldClock keeps the
+      rest of the sketch running whilst waiting for a response, rather than
+      stopping everything for a few milliseconds at a time.
+      @param aClock  Clock to use, or NULL to go back to millis() and delay()
+    */
+    void setClock(HttpClock* aClock);
+
     /** Disables sending the default request headers (Host and User Agent)
     */
     void noDefaultRequestHeaders();
@@ -293,14 +755,38 @@ public:
     // Inherited from Print
     // Note: 1st call to these indicates the user is sending the body, so if need
     // Note: be we should finish the header first
-    virtual size_t write(uint8_t aByte) { if (iState < eRequestSent) { finishHeaders(); }; return iStream-> write(aByte); };
-    virtual size_t write(const uint8_t *aBuffer, size_t aSize) { if (iState < eRequestSent) { finishHeaders(); }; return iStream->write(aBuffer, aSize); };
+    // Note: write(uint8_t) calls our own write(const uint8_t*, size_t), not a
+    // Note: subclass's, so WebSocketStream can use it to send frame headers
+    virtual size_t write(uint8_t aByte) { return HttpStream::write(&aByte, 1); };
+    virtual size_t write(const uint8_t *aBuffer, size_t aSize);
     // Inherited from Stream
     virtual int available();
     /** Read the next byte from the server.
       @return Byte read or -1 if there are no bytes available.
     */
     virtual int read();
+    /** Read up to aSize bytes of the response body in one go.
+      The read is limited to what is already buffered, the remainder of the
+      current chunk and the remainder of the Content-Length, so that the bytes
+      can be copied with a single call on the underlying stream.
+      @return Number of bytes read, 0 at the end of the body or -1 if there
+      are no bytes available.
+    */
+    virtual int read(uint8_t *aBuffer, size_t aSize);
+    /** Read aLength bytes of the response body, waiting up to the stream
+      timeout for them to arrive.  Hides Stream::readBytes() so that the body
+      is copied in blocks rather than a byte at a time.
+      @return Number of bytes placed in aBuffer
+    */
+    size_t readBytes(char *aBuffer, size_t aLength) { return readBytes((uint8_t*)aBuffer, aLength); };
+    size_t readBytes(uint8_t *aBuffer, size_t aLength);
+    /** Read up to aSize bytes of the body that have already arrived, never
+      waiting for more.  The same as read(aBuffer, aSize) here, but unlike
+      read() subclasses mustn't build it on readBytes()
+      @return Number of bytes read, 0 at the end of the body or -1 if there
+      are no bytes available yet
+    */
+    virtual int readAvailable(uint8_t *aBuffer, size_t aSize);
     virtual int peek() { return iStream->peek(); };
     virtual void flush() { iStream->flush(); };
 
@@ -313,60 +799,344 @@ protected:
     /** Send the first part of the request and the initial headers.
       @param aURLPath	Url to request
       @param aHttpMethod  Type of HTTP request to make, e.g. "GET", "POST", etc.
+      @param aQuery       Fields to add to aURLPath as a query string, if any
       @return 0 if successful, else error
     */
     int sendInitialHeaders(const char* aURLPath,
-                     const char* aHttpMethod);
+                     const char* aHttpMethod,
+                     HttpForm* aQuery = NULL);
+
+    /* startRequest(), with an optional query string
+    */
+    int startRequest(const char* aURLPath,
+                     HttpForm* aQuery,
+                     const char* aHttpMethod,
+                     const char* aContentType,
+                     int aContentLength,
+                     const byte aBody[]);
 
     /* Let the server know that we've reached the end of the headers
     */
     void finishHeaders();
 
+    /** Add to the request headers waiting to be sent.  They're held in
+      iTxBuffer until finishHeaders() unless the buffer fills up first
+    */
+    void bufferHeader(const uint8_t* aData, size_t aLength);
+    void bufferHeader(const char* aText)
+      { bufferHeader((const uint8_t*)aText, strlen(aText)); }
+
+    /** Add a number, in decimal, to the request headers waiting to be sent
+    */
+    void bufferHeaderValue(tHttpLength aValue);
+
+    /* Print that adds whatever is written to it to the request headers, so
+      an HttpForm can write a query string into the request line
+    */
+    class HeaderWriter : public Print
+    {
+    public:
+        HeaderWriter(HttpStream& aHttp) : iHttp(aHttp) {};
+        virtual size_t write(uint8_t c) { return write(&c, 1); };
+        virtual size_t write(const uint8_t* aData, size_t aLength)
+          { iHttp.bufferHeader(aData, aLength); return aLength; };
+
+        HttpStream& iHttp;
+    };
+
+    /** Send any request headers waiting in iTxBuffer
+    */
+    void flushHeaders();
+
+    /** Write to iStream, keeping count in iStats
+    */
+    size_t streamWrite(const uint8_t* aData, size_t aLength);
+
+    /** Return how long it's been since the request was started
+    */
+    unsigned long sinceRequestStart() { return iClock->now() - iStats.requestStart; };
+
+    /** Keep count of aLength bytes of the body having been read
+    */
+    void countBody(size_t aLength);
+
+    /** Send the body data waiting in iTxBuffer as a chunk
+    */
+    void flushChunk();
+
+    /** Send aLength bytes of aData as a chunk
+    */
+    void sendChunk(const uint8_t* aData, size_t aLength);
+
+    /** Get rid of what's left of the last response, so it isn't mistaken
+      for the start of the next one, and get ready for a new request
+    */
+    void finishResponse();
+
     /** Reading any pending data from the client (used in connection keep alive mode)
     */
     void flushStreamRx();
 
     // Number of milliseconds that we wait each time there isn't any data
     // available to be read (during status code and header processing)
-    static const int kHttpWaitForDataDelay = 1000;
+    static const int kHttpWaitForDataDelay = HTTP_WAIT_FOR_DATA_DELAY;
     // Number of milliseconds that we'll wait in total without receiveing any
     // data before returning HTTP_ERROR_TIMED_OUT (during status code and header
     // processing)
     static const int kHttpResponseTimeout = 30*1000;
-    static const char* kContentLengthPrefix;
-    static const char* kTransferEncodingChunked;
+    // Space left at the start of iTxBuffer for the size of a chunk, when the
+    // body is being sent chunked
+    static const size_t kChunkHeaderSize = 6;
+    static const char kHexDigits[];
+    static const uint8_t kHexValues[256];
+    static const char* kStatusPrefix;
+    static const char* kConnectionClose;
+    // Headers we always look out for in the response, in the order given by
+    // tKnownHeader
+    static const char* const kKnownHeaders[];
     typedef enum {
-        eIdle,
-        eRequestStarted,
-        eRequestSent,
-        eReadingStatusCode,
-        eStatusCodeRead,
-        eReadingContentLength,
-        eSkipToEndOfHeader,
-        eLineStartingCRFound,
-        eReadingBody,
-        eReadingChunkLength,
-        eReadingBodyChunk
-    } tHttpState;
+        eHeaderContentLength,
+        eHeaderTransferEncoding,
+        eHeaderContentEncoding,
+        eHeaderConnection,
+        eHeaderETag,
+        eHeaderLocation,
+        eHeaderLastModified,
+        eHeaderContentRange,
+        eKnownHeaderCount
+    } tKnownHeader;
+    static const int kMaxHeadersOfInterest = eKnownHeaderCount + HTTP_MAX_CAPTURED_HEADERS;
+    // Content codings we can find in the Content-Encoding header
+    typedef enum {
+        eCodingIdentity,
+        eCodingGzip,
+        eCodingDeflate,
+        eCodingUnsupported
+    } tContentCoding;
+    // How the cache is involved in the current request, in order.  The ones
+    // from eCacheStoring on are for the body
+    typedef enum {
+        // It isn't
+        eCacheUnused,
+        // We asked for a response that isn't cached
+        eCacheMiss,
+        // We asked whether the cached response has changed
+        eCacheHit,
+        // It has, or wasn't cached, so we're collecting the new validators
+        eCacheFetching,
+        // It hasn't changed
+        eCacheNotModified,
+        // The body is being stored as it's read
+        eCacheStoring,
+        // The body is being read from the cache
+        eCacheServing
+    } tCacheState;
+
+    /** Move the response parser on to aState
+    */
+#ifdef HTTP_STATE_TRACE
+    void setState(tHttpState aState);
+#else
+    void setState(tHttpState aState) { iState = aState; };
+#endif
+
+    /** Pause to give some more data a chance to arrive
+      @param aTimeoutStart  Time from iClock when we last received any data
+      @return false if we've already waited too long, else true
+    */
+    bool waitForData(unsigned long aTimeoutStart);
+
+    /** Read the next byte, waiting up to the stream timeout for it.  Hides
+      Stream::timedRead() so that it uses iClock
+      @return The byte read, or -1 if it didn't arrive in time
+    */
+    int timedRead();
+
+    /** Copy the rest of the response body to aOutput
+      @param aOutput  Where to send the body
+      @param aCopied  Incremented by the number of bytes sent to aOutput
+      @return HTTP_SUCCESS if successful, else an error
+    */
+    int copyBody(Print& aOutput, tHttpLength& aCopied);
+
+    /** Reset the state of the response parser, ready for a new response
+    */
+    void resetResponseState();
+
+    /** Keep calling poll() until the response reaches aState, pausing
+      whenever there is no data available
+      @return HTTP_SUCCESS if successful, else an error code
+    */
+    int waitForResponse(tHttpState aState);
+
+    /* Check the next character of a header name against the headers we're
+      interested in
+      @return true if it could still be, or is, one of them
+    */
+    bool matchHeaderName(char c);
+
+    /* Handle the next character of the value of a header we're interested in
+    */
+    void processHeaderValue(char c);
+
+    /* Process any chunk framing that has arrived in a chunked body
+    */
+    void readChunkFraming();
+
+    /* Move on to the data of the chunk whose size we've just read
+    */
+    void startChunk();
+
+    /* Finish off the name of a content coding in the Content-Encoding
+      header, and see if it's one we can decompress
+    */
+    void endContentCoding();
+
+    /* Start decompressing the body, if it needs it
+    */
+    void startDecoding();
+
+    /* Decide what to do with the cache now that the status code is known
+    */
+    void cacheStatusRead();
+
+    /* Start storing the body in the cache, or reading it from there, now
+      that the headers have been read
+    */
+    void startCaching();
+
+    /* Finish storing the body in the cache
+      @param aComplete  false if it didn't all arrive, so mustn't be used
+    */
+    void endCaching(bool aComplete);
+
+    /* Return where to collect the value of header aIndex for the cache, or
+      NULL if it isn't wanted
+    */
+    char* cacheValidator(uint8_t aIndex);
+
+    /* The parts of available(), read() and endOfBodyReached() that deal with
+      the body as it was sent, before any decompression
+    */
+    int rawAvailable();
+    int rawRead(uint8_t *aBuffer, size_t aSize);
+    bool endOfRawBodyReached();
+
+    /* Return true if we can tell where the body ends, so can tell when it's
+      been cut short: it has a Content-Length, is chunked, or is compressed
+    */
+    bool bodyEndKnown();
+
+    /* Give iInflater whatever has arrived of the compressed body, or
+      Inflater::kNotYet if nothing has
+    */
+    static int fillInflater(uint8_t* aBuffer, size_t aSize, void* aContext);
+
+    /* Add aDigit to the end of aValue, a number in base aBase
+      @return false if the result would be too big for a tHttpLength
+    */
+    static bool appendDigit(tHttpLength& aValue, uint8_t aBase, uint8_t aDigit);
+
+    /* Move aPosition on through aToken if c, in any case, is the next
+      character of it, or else start again, with c as its first character
+      if it can be.  Only for tokens whose first character isn't repeated
+      in them, as a partial match can then only restart there
+      @return true if that was the last character of aToken, and aPosition
+      is back at the start of it
+    */
+    static bool matchToken(const char*& aPosition, const char* aToken, char c);
+
+    /* Return the value of c as a hex digit, or 0xff if it isn't one
+    */
+    static uint8_t hexValue(char c) { return pgm_read_byte(&kHexValues[(uint8_t)c]); };
+
     // Stream we're using
     Stream* iStream;
+    // Used to tell the time and to wait for data
+    HttpClock* iClock;
     // Current state of the finite-state-machine
     tHttpState iState;
+    // Request line and headers waiting to be sent
+    uint8_t iTxBuffer[HTTP_TX_BUFFER_SIZE];
+    size_t iTxBufferLength;
+    // Whether the request body is being sent chunked, in which case
+    // iTxBuffer holds the chunk that's being put together
+    bool iTxChunked;
+    // Used to compress request bodies, if we've been asked to
+    Deflater* iDeflater;
+    // Whether what's written is being compressed with iDeflater
+    bool iTxDeflating;
     // Stores the status code for the response, once known
     int iStatusCode;
+    // How far through the status line prefix we are
+    const char* iStatusPtr;
     // Stores the value of the Content-Length header, if present
-    int iContentLength;
+    tHttpLength iContentLength;
     // How many bytes of the response body have been read by the user
-    int iBodyLengthConsumed;
-    // How far through a Content-Length header prefix we are
-    const char* iContentLengthPtr;
-    // How far through a Transfer-Encoding chunked header we are
+    tHttpLength iBodyLengthConsumed;
+    // Set if a length in the headers or chunk framing was too big to hold,
+    // so we can't tell where the body ends
+    bool iInvalidLength;
+    // Names of the headers we're interested in, starting with kKnownHeaders
+    const char* iHeaderNames[kMaxHeadersOfInterest];
+    // Where to store the value of each header, if anywhere
+    char* iHeaderValues[kMaxHeadersOfInterest];
+    size_t iHeaderValueSizes[kMaxHeadersOfInterest];
+    // How many entries of iHeaderNames are in use
+    uint8_t iHeaderCount;
+    // One bit for each header we need to look out for in the response
+    uint16_t iHeaderWatchMask;
+    // Headers whose names match what we've read of the current line so far
+    uint16_t iHeaderMatches;
+    // How far through the current header name we are
+    uint8_t iHeaderNameIndex;
+    // Which header's value we're reading
+    uint8_t iHeaderIndex;
+    // How many characters of the header's value we've read
+    size_t iHeaderValueLength;
+    // How far through a Transfer-Encoding chunked value we are
     const char* iTransferEncodingChunkedPtr;
     // Stores if the response body is chunked
     bool iIsChunked;
+    // First byte and total length from the Content-Range header, or -1
+    tHttpLength iContentRangeStart;
+    tHttpLength iContentRangeTotal;
+    // Which part of the Content-Range value we're reading
+    uint8_t iContentRangePart;
+    // Content coding the server applied to the body
+    tContentCoding iContentCoding;
+    // The content coding in Content-Encoding that we're part way through
+    char iContentCodingName[9];
+    uint8_t iContentCodingLength;
+    // Used to decompress the body, if we're asking for it to be compressed
+    Inflater* iInflater;
+    // Whether the body is being decompressed with iInflater
+    bool iDecoding;
+    // Where to keep responses, if anywhere, and what it's doing with the
+    // current one
+    HttpCache* iCache;
+    tCacheState iCacheState;
+    // Stores if the server sent "Connection: close"
+    bool iConnectionClose;
+    // How far through a Connection close value we are
+    const char* iConnectionClosePtr;
     // Stores the value of the current chunk length, if present
-    int iChunkLength;
+    tHttpLength iChunkLength;
     uint32_t iHttpResponseTimeout;
+    // Whether more requests can be sent before the responses are read
+    bool iPipelining;
+    // Number of pipelined responses to come after the current one
+    uint8_t iQueuedResponses;
+    // Timings and counters for the current request
+    HttpStats iStats;
+    // Who to tell as the body is read, if anyone
+    tProgressCallback iProgressCallback;
+    void* iProgressContext;
+#ifdef HTTP_STATE_TRACE
+    // Who to tell about each change of state, if anyone
+    tStateTraceCallback iStateTraceCallback;
+    void* iStateTraceContext;
+#endif
     String iHeaderLine;
 };
 
@@ -0,0 +1,284 @@
+// Class to keep several HttpStreams busy at once from a single loop
+// Released under Apache License, version 2.0
+
+#include "HttpStreamPool.h"
+
+// Clock for the pools which haven't been given one of their own
+static HttpClock defaultClock;
+
+HttpStreamPool::HttpStreamPool()
+ : iSlotCount(0), iNextSlot(0), iQueueStart(0), iQueueLength(0),
+   iClock(&defaultClock)
+{
+}
+
+bool HttpStreamPool::add(HttpStream& aHttp)
+{
+    if (iSlotCount == HTTP_POOL_MAX_STREAMS)
+    {
+        return false;
+    }
+
+    tSlot& slot = iSlots[iSlotCount++];
+
+    slot.iHttp = &aHttp;
+    slot.iState = eSlotIdle;
+    return true;
+}
+
+bool HttpStreamPool::reconnected(HttpStream& aHttp)
+{
+    for (uint8_t i = 0; i < iSlotCount; i++)
+    {
+        if (iSlots[i].iHttp == &aHttp)
+        {
+            if (iSlots[i].iState == eSlotNeedsReconnect)
+            {
+                iSlots[i].iState = eSlotIdle;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpStreamPool::request(const char* aURLPath, const char* aHttpMethod,
+                             tResponseCallback aCallback, void* aContext,
+                             Print* aOutput, const char* aContentType,
+                             int aContentLength, const byte aBody[])
+{
+    if (iQueueLength == HTTP_POOL_MAX_REQUESTS)
+    {
+        return false;
+    }
+
+    tRequest& request = iQueue[(iQueueStart + iQueueLength) % HTTP_POOL_MAX_REQUESTS];
+
+    request.iURLPath = aURLPath;
+    request.iHttpMethod = aHttpMethod;
+    request.iContentType = aContentType;
+    request.iContentLength = aContentLength;
+    request.iBody = aBody;
+    request.iCallback = aCallback;
+    request.iContext = aContext;
+    request.iOutput = aOutput;
+    iQueueLength++;
+    return true;
+}
+
+int HttpStreamPool::poll()
+{
+    for (uint8_t i = 0; i < iSlotCount; i++)
+    {
+        tSlot& slot = iSlots[(iNextSlot + i) % iSlotCount];
+
+        if ((slot.iState == eSlotIdle) && (iQueueLength > 0))
+        {
+            // Copy it out first, in case the callback queues another one
+            tRequest request = iQueue[iQueueStart];
+
+            iQueueStart = (iQueueStart + 1) % HTTP_POOL_MAX_REQUESTS;
+            iQueueLength--;
+            startRequest(slot, request);
+        }
+
+        if ((slot.iState != eSlotIdle) && (slot.iState != eSlotNeedsReconnect))
+        {
+            pollSlot(slot);
+        }
+    }
+
+    // Start with the next one next time, so none of them are always last
+    if (iSlotCount > 0)
+    {
+        iNextSlot = (iNextSlot + 1) % iSlotCount;
+    }
+    return pending();
+}
+
+int HttpStreamPool::pending()
+{
+    int count = iQueueLength;
+
+    for (uint8_t i = 0; i < iSlotCount; i++)
+    {
+        if ((iSlots[i].iState == eSlotWaitingForHeaders) ||
+            (iSlots[i].iState == eSlotCopyingBody))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void HttpStreamPool::setClock(HttpClock* aClock)
+{
+    iClock = aClock ? aClock : &defaultClock;
+}
+
+void HttpStreamPool::startRequest(tSlot& aSlot, const tRequest& aRequest)
+{
+    HttpStream& http = *aSlot.iHttp;
+
+    aSlot.iRequest = aRequest;
+    aSlot.iState = eSlotWaitingForHeaders;
+
+    int ret = http.startRequest(aRequest.iURLPath, aRequest.iHttpMethod,
+                                aRequest.iContentType, aRequest.iContentLength,
+                                aRequest.iBody);
+
+    if (HTTP_SUCCESS != ret)
+    {
+        finish(aSlot, ret, false);
+        return;
+    }
+    aSlot.iResponseBytes = http.stats().responseBytes;
+    aSlot.iLastActivity = iClock->now();
+}
+
+void HttpStreamPool::pollSlot(tSlot& aSlot)
+{
+    HttpStream& http = *aSlot.iHttp;
+
+    if (aSlot.iState == eSlotWaitingForHeaders)
+    {
+        int ret;
+
+        // Carry on into the headers if the status line has just been read
+        do
+        {
+            ret = http.poll();
+        } while (ret == HTTP_POLL_STATUS_READY);
+
+        if (ret < 0)
+        {
+            finish(aSlot, ret, false);
+            return;
+        }
+        else if (ret == HTTP_POLL_HEADERS_DONE)
+        {
+            if (!aSlot.iRequest.iOutput)
+            {
+                // The callback will read the body.  Now the headers have
+                // been read canReuseConnection() won't wait for anything
+                finish(aSlot, http.responseStatusCode(), http.canReuseConnection());
+                return;
+            }
+            aSlot.iState = eSlotCopyingBody;
+        }
+    }
+
+    if (aSlot.iState == eSlotCopyingBody)
+    {
+        int ret = copyBody(aSlot, aSlot.iRequest.iOutput);
+
+        if (HTTP_SUCCESS == ret)
+        {
+            finish(aSlot, http.responseStatusCode(), http.canReuseConnection());
+            return;
+        }
+        else if (ret != HTTP_POLL_IN_PROGRESS)
+        {
+            finish(aSlot, ret, false);
+            return;
+        }
+    }
+    else if (aSlot.iState == eSlotDraining)
+    {
+        if (copyBody(aSlot, NULL) != HTTP_POLL_IN_PROGRESS)
+        {
+            // It's ready for the next request
+            http.resetState();
+            aSlot.iState = eSlotIdle;
+            return;
+        }
+    }
+
+    // Give up on it if the response has stopped arriving
+    if (http.stats().responseBytes != aSlot.iResponseBytes)
+    {
+        aSlot.iResponseBytes = http.stats().responseBytes;
+        aSlot.iLastActivity = iClock->now();
+    }
+    else if ((iClock->now() - aSlot.iLastActivity) >= http.httpResponseTimeout())
+    {
+        if (aSlot.iState == eSlotDraining)
+        {
+            // The callback has already been told it's reusable, so all we
+            // can do is give up on the rest of the body
+            http.resetState();
+            aSlot.iState = eSlotIdle;
+        }
+        else if ((aSlot.iState == eSlotCopyingBody) && !http.isResponseChunked() &&
+                 (http.contentLength() == HttpStream::kNoContentLengthHeader))
+        {
+            // We can't tell where the body ends, except that it has stopped
+            // arriving, so that's all of it
+            finish(aSlot, http.responseStatusCode(), false);
+        }
+        else
+        {
+            finish(aSlot, HTTP_ERROR_TIMED_OUT, false);
+        }
+    }
+}
+
+int HttpStreamPool::copyBody(tSlot& aSlot, Print* aOutput)
+{
+    HttpStream& http = *aSlot.iHttp;
+    uint8_t block[HTTP_RX_BLOCK_SIZE];
+
+    while (!http.endOfBodyReached())
+    {
+        // Only read what has already arrived, so read() doesn't wait
+        int available = http.available();
+
+        if (available <= 0)
+        {
+            return HTTP_POLL_IN_PROGRESS;
+        }
+
+        int count = http.read(block, ((size_t)available < sizeof(block)) ? available : sizeof(block));
+
+        if (count == 0)
+        {
+            break;
+        }
+        else if (count < 0)
+        {
+            return HTTP_POLL_IN_PROGRESS;
+        }
+
+        if (aOutput && (aOutput->write(block, count) != (size_t)count))
+        {
+            return HTTP_ERROR_WRITE_FAILED;
+        }
+    }
+    return HTTP_SUCCESS;
+}
+
+void HttpStreamPool::finish(tSlot& aSlot, int aStatus, bool aReusable)
+{
+    HttpStream& http = *aSlot.iHttp;
+
+    // Free the slot first, so the callback can queue another request, or
+    // say it has reconnected
+    aSlot.iState = aReusable ? eSlotDraining : eSlotNeedsReconnect;
+    if (aSlot.iRequest.iCallback)
+    {
+        aSlot.iRequest.iCallback(http, aStatus, aReusable, aSlot.iRequest.iContext);
+    }
+
+    if (!aReusable)
+    {
+        // Whatever state it's been left in, get it ready for another request
+        // once it has been reconnected
+        http.resetState();
+    }
+    else if (http.endOfBodyReached())
+    {
+        // There's nothing left to throw away
+        http.resetState();
+        aSlot.iState = eSlotIdle;
+    }
+}
@@ -0,0 +1,163 @@
+// Class to keep several HttpStreams busy at once from a single loop
+// Released under Apache License, version 2.0
+
+#ifndef HttpStreamPool_h
+#define HttpStreamPool_h
+
+#include <Arduino.h>
+#include "HttpStream.h"
+
+// Most HttpStreams a pool can look after
+#ifndef HTTP_POOL_MAX_STREAMS
+#define HTTP_POOL_MAX_STREAMS 4
+#endif
+
+// Most requests that can be waiting for a free HttpStream
+#ifndef HTTP_POOL_MAX_REQUESTS
+#define HTTP_POOL_MAX_REQUESTS 8
+#endif
+
+// Runs requests on whichever of its HttpStreams is free, and moves all of
+// them along a bit at a time with poll(), so that one slow server doesn't
+// hold up the rest.  Each HttpStream should be on its own connection, e.g.
+// to a different server, and it's up to you to keep them connected.  Once
+// a connection has to be closed the pool leaves its HttpStream alone until
+// reconnected() says it has been opened again.
+class HttpStreamPool
+{
+public:
+    /** Called once a request has finished.  If the request was given
+      somewhere to send the body that has all been sent, otherwise it's
+      called as soon as the headers have been read and the body can be read
+      from aHttp as usual, although that will block until it has arrived.
+      Whatever's left of the body afterwards is thrown away by poll() as it
+      arrives, before the pool gives aHttp another request.
+      @param aHttp      HttpStream the request was made on
+      @param aStatus    Status code of the response, else an HTTP_ERROR_* code
+      @param aReusable  false if aHttp's connection must be closed and opened
+                        again, and reconnected() called, before the pool
+                        gives it another request
+      @param aContext   Passed to request()
+    */
+    typedef void (*tResponseCallback)(HttpStream& aHttp, int aStatus, bool aReusable, void* aContext);
+
+    HttpStreamPool();
+
+    /** Add aHttp to the HttpStreams that requests are run on
+      @return false if the pool is full
+    */
+    bool add(HttpStream& aHttp);
+
+    /** Queue a request to run on the next free HttpStream.  Nothing is
+      copied, so the path, content type and body must stay around until the
+      request has been sent.
+      @param aURLPath      Url to request
+      @param aHttpMethod   Type of HTTP request to make, e.g. HTTP_METHOD_GET
+      @param aCallback     Called when the request has finished
+      @param aContext      Passed on to aCallback
+      @param aOutput       Where to send the body as it arrives, or NULL to
+                           read it yourself in aCallback
+      @param aContentType  Content type of the request body, if any
+      @param aContentLength  Length of aBody
+      @param aBody         Body of the request, if any
+      @return false if there's no room in the queue
+    */
+    bool request(const char* aURLPath, const char* aHttpMethod,
+                 tResponseCallback aCallback, void* aContext = NULL,
+                 Print* aOutput = NULL, const char* aContentType = NULL,
+                 int aContentLength = -1, const byte aBody[] = NULL);
+
+    /** Queue a GET request, see request()
+    */
+    bool get(const char* aURLPath, tResponseCallback aCallback,
+             void* aContext = NULL, Print* aOutput = NULL)
+      { return request(aURLPath, HTTP_METHOD_GET, aCallback, aContext, aOutput); };
+
+    /** Tell the pool that aHttp's connection has been opened again, after a
+      request on it finished with aReusable false, so that it can be given
+      more requests.  It's fine to call this from the callback
+      @return false if aHttp isn't in the pool
+    */
+    bool reconnected(HttpStream& aHttp);
+
+    /** Do whatever can be done without waiting: start queued requests on
+      any free HttpStreams, and process whatever has arrived for the rest.
+      Call this often, e.g. every time round loop()
+      @return Number of requests which haven't finished yet
+    */
+    int poll();
+
+    /** Return the number of requests which haven't finished yet
+    */
+    int pending();
+
+    /** Use aClock to tell when a response has stopped arriving, rather
+      than millis()
+    */
+    void setClock(HttpClock* aClock);
+
+protected:
+    // A request, queued or in progress
+    typedef struct {
+        const char* iURLPath;
+        const char* iHttpMethod;
+        const char* iContentType;
+        int iContentLength;
+        const byte* iBody;
+        tResponseCallback iCallback;
+        void* iContext;
+        Print* iOutput;
+    } tRequest;
+
+    typedef enum {
+        eSlotIdle,
+        eSlotWaitingForHeaders,
+        eSlotCopyingBody,
+        // The request has finished, but the rest of its body has to be
+        // thrown away before the next one can start
+        eSlotDraining,
+        // The connection has to be opened again before the next request
+        eSlotNeedsReconnect
+    } tSlotState;
+
+    // An HttpStream and what it's doing
+    typedef struct {
+        HttpStream* iHttp;
+        tSlotState iState;
+        tRequest iRequest;
+        // How much of the response had arrived when we last looked, and
+        // when that was
+        unsigned long iResponseBytes;
+        unsigned long iLastActivity;
+    } tSlot;
+
+    /* Start aRequest on the HttpStream in aSlot
+    */
+    void startRequest(tSlot& aSlot, const tRequest& aRequest);
+    /* Move aSlot's request along with whatever has arrived
+    */
+    void pollSlot(tSlot& aSlot);
+    /* Copy whatever has arrived of the body to aOutput, or throw it away
+      if aOutput is NULL
+      @return HTTP_SUCCESS once all of the body has been copied,
+      HTTP_POLL_IN_PROGRESS if there's more to come, else an error
+    */
+    int copyBody(tSlot& aSlot, Print* aOutput);
+    /* Tell whoever made aSlot's request how it went, and free up aSlot,
+      leave it to drain the rest of the body if its connection is reusable,
+      or leave it until it's reconnected if not
+    */
+    void finish(tSlot& aSlot, int aStatus, bool aReusable);
+
+    tSlot iSlots[HTTP_POOL_MAX_STREAMS];
+    uint8_t iSlotCount;
+    // Which slot poll() starts with, so they all get a fair turn
+    uint8_t iNextSlot;
+    // Requests waiting for a free slot, as a circular buffer
+    tRequest iQueue[HTTP_POOL_MAX_REQUESTS];
+    uint8_t iQueueStart;
+    uint8_t iQueueLength;
+    HttpClock* iClock;
+};
+
+#endif
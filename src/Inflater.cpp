@@ -0,0 +1,697 @@
+// Class to decompress deflate, zlib and gzip data a piece at a time
+// Released under Apache License, version 2.0
+
+#include "Inflater.h"
+#include "DeflateTables.h"
+
+// The order the code lengths for the code length code are sent in
+static const uint8_t kCodeLengthOrder[19] PROGMEM = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Flags in the gzip header
+static const uint8_t kGzipFlagHeaderCRC = 0x02;
+static const uint8_t kGzipFlagExtra = 0x04;
+static const uint8_t kGzipFlagName = 0x08;
+static const uint8_t kGzipFlagComment = 0x10;
+
+Inflater::Inflater(uint8_t* aWindow, size_t aWindowSize)
+ : iWindow(aWindow), iWindowSize(aWindowSize)
+{
+    begin(eFormatDeflate, NULL, NULL);
+}
+
+void Inflater::begin(tFormat aFormat, tFillFunction aFill, void* aContext)
+{
+    iState = eHeader;
+    iStep = 0;
+    iCount = 0;
+    iWaiting = false;
+    iFormat = aFormat;
+    iZlib = false;
+    iLastBlock = false;
+    iFill = aFill;
+    iFillContext = aContext;
+    iInputPos = 0;
+    iInputLength = 0;
+    iBitBuffer = 0;
+    iBitCount = 0;
+    iWindowPos = 0;
+    iWindowFill = 0;
+    iStoredLength = 0;
+    iCopyLength = 0;
+    iCopyDistance = 0;
+}
+
+int Inflater::read(uint8_t* aBuffer, size_t aSize)
+{
+    size_t count = 0;
+
+    iWaiting = false;
+    while ((count < aSize) && (iState != eDone) && (iState != eFailed) && !iWaiting)
+    {
+        int c = -1;
+
+        if (iCopyLength > 0)
+        {
+            // Repeat some of what we've already output
+            size_t from = (iWindowPos < iCopyDistance) ?
+                              iWindowPos + iWindowSize - iCopyDistance :
+                              iWindowPos - iCopyDistance;
+            c = iWindow[from];
+            iCopyLength--;
+        }
+        else
+        {
+            switch(iState)
+            {
+            case eHeader:
+                readHeader();
+                break;
+            case eBlockHeader:
+                readBlockHeader();
+                break;
+            case eDynamicCodes:
+                readDynamicCodes();
+                break;
+            case eStoredBlock:
+                if (iStoredLength == 0)
+                {
+                    iState = iLastBlock ? eTrailer : eBlockHeader;
+                    iStep = 0;
+                }
+                else if (needBits(8))
+                {
+                    c = takeBits(8);
+                    iStoredLength--;
+                }
+                break;
+            case eCompressedBlock:
+                c = readCompressed();
+                break;
+            case eTrailer:
+                readTrailer();
+                break;
+            default:
+                break;
+            };
+        }
+
+        if ((c >= 0) && (iState != eFailed))
+        {
+            // Keep a copy in case it gets repeated later on
+            iWindow[iWindowPos++] = c;
+            if (iWindowPos == iWindowSize)
+            {
+                iWindowPos = 0;
+            }
+            if (iWindowFill < iWindowSize)
+            {
+                iWindowFill++;
+            }
+            aBuffer[count++] = c;
+        }
+    }
+
+    if (count > 0)
+    {
+        return count;
+    }
+    else if (iState == eFailed)
+    {
+        return -1;
+    }
+    return iWaiting ? kNotYet : 0;
+}
+
+void Inflater::readHeader()
+{
+    if (iFormat != eFormatGzip)
+    {
+        if (!needBits(16))
+        {
+            return;
+        }
+
+        uint8_t method = iBitBuffer & 0xff;
+        uint8_t flags = (iBitBuffer >> 8) & 0xff;
+
+        // A zlib header is a multiple of 31, and says it uses deflate.
+        // Otherwise it's raw deflate, so those are the first bits of the
+        // data and are left for the block header
+        iZlib = ((((method << 8) | flags) % 31) == 0) && ((method & 0x0f) == 8);
+        if (iZlib)
+        {
+            takeBits(16);
+            if (flags & 0x20)
+            {
+                // It needs a preset dictionary, which we don't have
+                fail();
+                return;
+            }
+        }
+        iState = eBlockHeader;
+        iStep = 0;
+        return;
+    }
+
+    while (iState == eHeader)
+    {
+        switch (iStep)
+        {
+        case 0:
+            if (!needBits(16))
+            {
+                return;
+            }
+            if ((takeBits(8) != 0x1f) || (takeBits(8) != 0x8b))
+            {
+                // Not gzip
+                fail();
+                return;
+            }
+            break;
+        case 1:
+            if (!needBits(16))
+            {
+                return;
+            }
+            if (takeBits(8) != 8)
+            {
+                // Not compressed with deflate
+                fail();
+                return;
+            }
+            iGzipFlags = takeBits(8);
+            // Then the modification time, extra flags and OS
+            iCount = 6;
+            break;
+        case 2:
+            if (!skipBytes())
+            {
+                return;
+            }
+            break;
+        case 3:
+            if (iGzipFlags & kGzipFlagExtra)
+            {
+                if (!needBits(16))
+                {
+                    return;
+                }
+                iCount = takeBits(16);
+            }
+            break;
+        case 4:
+            if (!skipBytes())
+            {
+                return;
+            }
+            break;
+        case 5:
+            if ((iGzipFlags & kGzipFlagName) && !skipString())
+            {
+                return;
+            }
+            break;
+        case 6:
+            if ((iGzipFlags & kGzipFlagComment) && !skipString())
+            {
+                return;
+            }
+            iCount = (iGzipFlags & kGzipFlagHeaderCRC) ? 2 : 0;
+            break;
+        case 7:
+            if (!skipBytes())
+            {
+                return;
+            }
+            iState = eBlockHeader;
+            break;
+        };
+        iStep++;
+    }
+    iStep = 0;
+}
+
+void Inflater::readBlockHeader()
+{
+    if (iStep == 0)
+    {
+        if (!needBits(3))
+        {
+            return;
+        }
+        iLastBlock = takeBits(1);
+
+        switch(takeBits(2))
+        {
+        case 0:
+            // Stored, which starts at the next byte
+            takeBits(iBitCount % 8);
+            iStep = 1;
+            break;
+        case 1:
+            {
+                // Compressed with the fixed codes
+                uint8_t lengths[kMaxLiteralSymbols];
+                int i = 0;
+
+                while (i < 144)
+                {
+                    lengths[i++] = 8;
+                }
+                while (i < 256)
+                {
+                    lengths[i++] = 9;
+                }
+                while (i < 280)
+                {
+                    lengths[i++] = 7;
+                }
+                while (i < 288)
+                {
+                    lengths[i++] = 8;
+                }
+                buildCode(iLiteralCounts, iLiteralSymbols, lengths, kMaxLiteralSymbols);
+                // Distance codes 30 and 31 are never used, but they're part
+                // of the code
+                memset(lengths, 5, kMaxDistanceSymbols);
+                buildCode(iDistanceCounts, iDistanceSymbols, lengths, kMaxDistanceSymbols);
+                iState = eCompressedBlock;
+            }
+            return;
+        case 2:
+            iState = eDynamicCodes;
+            return;
+        default:
+            fail();
+            return;
+        };
+    }
+
+    // The length of a stored block, and its complement
+    if (iStep == 1)
+    {
+        if (!needBits(16))
+        {
+            return;
+        }
+        iStoredLength = takeBits(16);
+        iStep = 2;
+    }
+
+    if (!needBits(16))
+    {
+        return;
+    }
+    if (iStoredLength != (uint16_t)~takeBits(16))
+    {
+        fail();
+        return;
+    }
+    iState = eStoredBlock;
+    iStep = 0;
+}
+
+void Inflater::readDynamicCodes()
+{
+    // The lengths are kept in iLiteralSymbols until they've all been read,
+    // as that code isn't needed until then
+    uint8_t* lengths = (uint8_t*)iLiteralSymbols;
+
+    if (iStep == 0)
+    {
+        if (!needBits(14))
+        {
+            return;
+        }
+        iLiteralCount = takeBits(5) + 257;
+        iDistanceCount = takeBits(5) + 1;
+        iCodeLengthCount = takeBits(4) + 4;
+
+        if ((iLiteralCount > 286) || (iDistanceCount > kDeflateDistanceCodes))
+        {
+            fail();
+            return;
+        }
+        memset(lengths, 0, 19);
+        iCount = 0;
+        iStep = 1;
+    }
+
+    if (iStep == 1)
+    {
+        // First comes the code used to send the code lengths.  We can use
+        // the distance code to hold it, as it'll be replaced afterwards
+        while (iCount < iCodeLengthCount)
+        {
+            if (!needBits(3))
+            {
+                return;
+            }
+            lengths[pgm_read_byte(&kCodeLengthOrder[iCount++])] = takeBits(3);
+        }
+        if (!buildCode(iDistanceCounts, iDistanceSymbols, lengths, 19))
+        {
+            fail();
+            return;
+        }
+        iCount = 0;
+        iStep = 2;
+    }
+
+    // Then the code lengths for both of the codes, run-length encoded
+    int total = iLiteralCount + iDistanceCount;
+
+    while (iCount < total)
+    {
+        uint8_t codeLength;
+        int symbol = peekSymbol(iDistanceCounts, iDistanceSymbols, codeLength);
+
+        if (symbol < 0)
+        {
+            return;
+        }
+
+        // Make sure the extra bits are there too before using any of them
+        uint8_t extraBits = (symbol < 16) ? 0 : ((symbol == 16) ? 2 : ((symbol == 17) ? 3 : 7));
+
+        if (!needBits(codeLength + extraBits))
+        {
+            return;
+        }
+        takeBits(codeLength);
+
+        uint8_t length = 0;
+        int repeat;
+
+        if (symbol < 16)
+        {
+            lengths[iCount++] = symbol;
+            continue;
+        }
+        else if (symbol == 16)
+        {
+            // Repeat the previous length
+            if (iCount == 0)
+            {
+                fail();
+                return;
+            }
+            length = lengths[iCount-1];
+            repeat = 3 + takeBits(2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + takeBits(3);
+        }
+        else
+        {
+            repeat = 11 + takeBits(7);
+        }
+
+        if (iCount + repeat > total)
+        {
+            fail();
+            return;
+        }
+        memset(lengths + iCount, length, repeat);
+        iCount += repeat;
+    }
+
+    // Copy them out of the way before building the literal code over them
+    uint8_t codeLengths[kMaxLiteralSymbols + kMaxDistanceSymbols];
+
+    memcpy(codeLengths, lengths, total);
+
+    // There has to be a code for the end of the block
+    if ((codeLengths[256] == 0) ||
+        !buildCode(iLiteralCounts, iLiteralSymbols, codeLengths, iLiteralCount) ||
+        !buildCode(iDistanceCounts, iDistanceSymbols, codeLengths + iLiteralCount, iDistanceCount))
+    {
+        fail();
+        return;
+    }
+    iState = eCompressedBlock;
+    iStep = 0;
+}
+
+int Inflater::readCompressed()
+{
+    uint8_t codeLength;
+    int symbol;
+
+    if (iStep == 0)
+    {
+        symbol = peekSymbol(iLiteralCounts, iLiteralSymbols, codeLength);
+        if (symbol < 0)
+        {
+            return -1;
+        }
+        else if (symbol < 256)
+        {
+            takeBits(codeLength);
+            return symbol;
+        }
+        else if (symbol == 256)
+        {
+            // End of the block
+            takeBits(codeLength);
+            iState = iLastBlock ? eTrailer : eBlockHeader;
+            return -1;
+        }
+        else if (symbol - 257 >= kDeflateLengthCodes)
+        {
+            fail();
+            return -1;
+        }
+
+        // It's a length, which will be followed by a distance
+        symbol -= 257;
+
+        uint8_t extraBits = pgm_read_byte(&kDeflateLengthExtraBits[symbol]);
+
+        if (!needBits(codeLength + extraBits))
+        {
+            return -1;
+        }
+        takeBits(codeLength);
+        iCount = pgm_read_word(&kDeflateLengthBase[symbol]) + takeBits(extraBits);
+        iStep = 1;
+    }
+
+    if (iStep == 1)
+    {
+        symbol = peekSymbol(iDistanceCounts, iDistanceSymbols, codeLength);
+        if (symbol < 0)
+        {
+            return -1;
+        }
+        else if (symbol >= kDeflateDistanceCodes)
+        {
+            fail();
+            return -1;
+        }
+        // The extra bits for a distance can be too many to wait for along
+        // with the code, so they get a step of their own
+        takeBits(codeLength);
+        iCopyDistance = symbol;
+        iStep = 2;
+    }
+
+    uint8_t extraBits = pgm_read_byte(&kDeflateDistanceExtraBits[iCopyDistance]);
+
+    if (!needBits(extraBits))
+    {
+        return -1;
+    }
+
+    uint16_t distance = pgm_read_word(&kDeflateDistanceBase[iCopyDistance]) + takeBits(extraBits);
+
+    if (distance > iWindowFill)
+    {
+        // Either it's invalid or it's further back than our window reaches
+        fail();
+        return -1;
+    }
+    iCopyDistance = distance;
+    iCopyLength = iCount;
+    iStep = 0;
+    return -1;
+}
+
+void Inflater::readTrailer()
+{
+    if (iStep == 0)
+    {
+        // The trailer starts at the next byte.  We don't check the CRC-32
+        // and length of gzip, or the Adler-32 of zlib, the transport
+        // already protects against corruption
+        takeBits(iBitCount % 8);
+        iCount = (iFormat == eFormatGzip) ? 8 : (iZlib ? 4 : 0);
+        iStep = 1;
+    }
+
+    if (!skipBytes())
+    {
+        if (failed())
+        {
+            // All the data has been output, so even if the trailer was
+            // missing there's nothing more we can do
+            iState = eDone;
+        }
+        return;
+    }
+    iState = eDone;
+}
+
+bool Inflater::buildCode(uint16_t* aCounts, uint16_t* aSymbols,
+                         const uint8_t* aLengths, int aCount)
+{
+    uint16_t offsets[kMaxCodeLength+1];
+    int codes = 0;
+
+    memset(aCounts, 0, (kMaxCodeLength+1) * sizeof(aCounts[0]));
+    for (int i = 0; i < aCount; i++)
+    {
+        if (aLengths[i])
+        {
+            aCounts[aLengths[i]]++;
+        }
+    }
+
+    // Work out where the codes of each length start, making sure there
+    // aren't more of them than will fit
+    int spare = 1;
+
+    for (int length = 0; length <= kMaxCodeLength; length++)
+    {
+        if (aCounts[length] > spare)
+        {
+            return false;
+        }
+        spare = 2 * (spare - aCounts[length]);
+        offsets[length] = codes;
+        codes += aCounts[length];
+    }
+
+    // Any gaps in the code would leave bit patterns we can't decode, which
+    // is only allowed when there's just a single code
+    if (((codes > 1) && (spare > 0)) || ((codes == 1) && (aCounts[1] != 1)))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < aCount; i++)
+    {
+        if (aLengths[i])
+        {
+            aSymbols[offsets[aLengths[i]]++] = i;
+        }
+    }
+
+    if (codes == 1)
+    {
+        // Make the unused bit pattern decode to an invalid symbol
+        aCounts[1] = 2;
+        aSymbols[1] = kInvalidSymbol;
+    }
+    return true;
+}
+
+int Inflater::peekSymbol(const uint16_t* aCounts, const uint16_t* aSymbols, uint8_t& aLength)
+{
+    // Canonical Huffman codes of each length are consecutive values, so
+    // work down the lengths until we find the one this code belongs to,
+    // only waiting for as many bits as that needs
+    int first = 0;
+    int offset = 0;
+
+    for (uint8_t length = 1; length <= kMaxCodeLength; length++)
+    {
+        if (!needBits(length))
+        {
+            return -1;
+        }
+        offset = (offset << 1) | ((iBitBuffer >> (length - 1)) & 1);
+        if (offset < aCounts[length])
+        {
+            if (aSymbols[first + offset] == kInvalidSymbol)
+            {
+                break;
+            }
+            aLength = length;
+            return aSymbols[first + offset];
+        }
+        first += aCounts[length];
+        offset -= aCounts[length];
+    }
+    // That isn't one of the codes
+    fail();
+    return -1;
+}
+
+bool Inflater::needBits(uint8_t aCount)
+{
+    while (iBitCount < aCount)
+    {
+        if (iInputPos == iInputLength)
+        {
+            int ret = iFill ? iFill(iInput, sizeof(iInput), iFillContext) : 0;
+
+            if (ret == kNotYet)
+            {
+                // Try again next time
+                iWaiting = true;
+                return false;
+            }
+            else if (ret <= 0)
+            {
+                // There's no more, or it's stopped arriving
+                fail();
+                return false;
+            }
+            iInputPos = 0;
+            iInputLength = ret;
+        }
+        iBitBuffer |= (uint32_t)iInput[iInputPos++] << iBitCount;
+        iBitCount += 8;
+    }
+    return true;
+}
+
+uint16_t Inflater::takeBits(uint8_t aCount)
+{
+    uint16_t bits = iBitBuffer & ((1UL << aCount) - 1);
+
+    iBitBuffer >>= aCount;
+    iBitCount -= aCount;
+    return bits;
+}
+
+bool Inflater::skipBytes()
+{
+    while (iCount > 0)
+    {
+        if (!needBits(8))
+        {
+            return false;
+        }
+        takeBits(8);
+        iCount--;
+    }
+    return true;
+}
+
+bool Inflater::skipString()
+{
+    do
+    {
+        if (!needBits(8))
+        {
+            return false;
+        }
+    } while (takeBits(8));
+    return true;
+}
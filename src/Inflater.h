@@ -0,0 +1,183 @@
+// Class to decompress deflate, zlib and gzip data a piece at a time
+// Released under Apache License, version 2.0
+
+#ifndef Inflater_h
+#define Inflater_h
+
+#include <Arduino.h>
+
+class Inflater
+{
+public:
+    // Which wrapper to expect around the compressed data
+    typedef enum {
+        // zlib (RFC 1950), or raw deflate (RFC 1951) data as some servers
+        // send for "Content-Encoding: deflate"
+        eFormatDeflate,
+        // gzip (RFC 1952)
+        eFormatGzip
+    } tFormat;
+
+    /** Called when more compressed data is needed.  Should either wait for
+      at least one byte to arrive, or return kNotYet straight away, in which
+      case read() returns what it has so far and carries on from the same
+      place next time.
+      @return Number of bytes put in aBuffer, 0 if there is no more data,
+      kNotYet if there's none yet, or -1 if it stopped arriving
+    */
+    typedef int (*tFillFunction)(uint8_t* aBuffer, size_t aSize, void* aContext);
+    static const int kNotYet = -2;
+
+    /** Create an Inflater which keeps the data it has decompressed in aWindow
+      so that it can be copied again.  aWindow must be at least as big as the
+      window the data was compressed with (32KB unless the server has been
+      configured with a smaller one), otherwise decompression will fail when
+      it refers back further than aWindow.
+      @param aWindow      Buffer for the data decompressed so far
+      @param aWindowSize  Size of aWindow
+    */
+    Inflater(uint8_t* aWindow, size_t aWindowSize);
+
+    /** Start decompressing a new piece of data
+      @param aFormat   Which wrapper to expect around the compressed data
+      @param aFill     Function to call to get more compressed data
+      @param aContext  Passed on to aFill
+    */
+    void begin(tFormat aFormat, tFillFunction aFill, void* aContext);
+
+    /** Decompress up to aSize bytes into aBuffer
+      @return Number of bytes decompressed, 0 at the end of the data,
+      kNotYet if the fill function had nothing yet, or -1 if the data is
+      invalid or stopped arriving
+    */
+    int read(uint8_t* aBuffer, size_t aSize);
+
+    /** Return the number of bytes that can be decompressed without needing
+      any more compressed data
+    */
+    int available() { return iCopyLength; };
+
+    /** Test whether all of the data has been decompressed
+    */
+    bool finished() { return iState == eDone; };
+
+    /** Test whether decompression has failed
+    */
+    bool failed() { return iState == eFailed; };
+
+protected:
+    // Each of these carries on from iStep, and only uses up its input once
+    // it all has arrived, so if the fill function has none yet it can
+    // return and be called again later to pick up where it left off
+
+    /* Read the gzip or zlib header */
+    void readHeader();
+    /* Read the start of the next deflate block */
+    void readBlockHeader();
+    /* Read the Huffman codes for a block compressed with dynamic codes */
+    void readDynamicCodes();
+    /* Read the next literal, or length and distance, of a compressed block
+      @return The literal, or -1 if it wasn't one
+    */
+    int readCompressed();
+    /* Read the gzip or zlib trailer */
+    void readTrailer();
+
+    /* Build the Huffman code for aCount symbols from their code lengths
+      @return false if aLengths don't describe a valid code
+    */
+    static bool buildCode(uint16_t* aCounts, uint16_t* aSymbols,
+                          const uint8_t* aLengths, int aCount);
+    /* Decode the next symbol using the given Huffman code, without using up
+      its bits, and put the length of its code in aLength
+      @return The symbol, or -1 if it couldn't be read
+    */
+    int peekSymbol(const uint16_t* aCounts, const uint16_t* aSymbols, uint8_t& aLength);
+    /* Make sure there are at least aCount bits, up to 24, in iBitBuffer
+      @return false if they aren't there yet, or never will be
+    */
+    bool needBits(uint8_t aCount);
+    /* Use up aCount bits, which must already be in iBitBuffer, least
+      significant first
+    */
+    uint16_t takeBits(uint8_t aCount);
+    /* Skip iCount bytes
+      @return false if they haven't all arrived yet
+    */
+    bool skipBytes();
+    /* Skip bytes up to and including a zero one
+      @return false if it hasn't arrived yet
+    */
+    bool skipString();
+    /* Give up on the data */
+    void fail() { iState = eFailed; iCopyLength = 0; };
+
+    // Largest number of symbols in each of the codes
+    static const int kMaxLiteralSymbols = 288;
+    static const int kMaxDistanceSymbols = 32;
+    static const int kMaxCodeLength = 15;
+    // What the unused bit pattern of a code with only one symbol decodes
+    // to, so using it fails
+    static const uint16_t kInvalidSymbol = 0xffff;
+
+    typedef enum {
+        eHeader,
+        eBlockHeader,
+        eDynamicCodes,
+        eStoredBlock,
+        eCompressedBlock,
+        eTrailer,
+        eDone,
+        eFailed
+    } tInflaterState;
+
+    tInflaterState iState;
+    // How far through the current state we've got, and a count that goes
+    // with it, e.g. of the bytes left to skip
+    uint8_t iStep;
+    uint16_t iCount;
+    // Whether the fill function had nothing for us yet
+    bool iWaiting;
+    // gzip header flags
+    uint8_t iGzipFlags;
+    // Sizes of the codes being read for a dynamic block
+    uint16_t iLiteralCount;
+    uint8_t iDistanceCount;
+    uint8_t iCodeLengthCount;
+    tFormat iFormat;
+    // Whether the data has a zlib wrapper, rather than being raw deflate
+    bool iZlib;
+    // Whether we're in the last block of the data
+    bool iLastBlock;
+    // Where to get more compressed data
+    tFillFunction iFill;
+    void* iFillContext;
+    // Compressed data waiting to be decompressed
+    uint8_t iInput[16];
+    uint8_t iInputPos;
+    uint8_t iInputLength;
+    // Bits from iInput waiting to be used, least significant first
+    uint32_t iBitBuffer;
+    uint8_t iBitCount;
+    // Decompressed data, kept so that it can be copied again
+    uint8_t* iWindow;
+    size_t iWindowSize;
+    // Where the next decompressed byte goes in iWindow
+    size_t iWindowPos;
+    // How much of iWindow has been filled
+    size_t iWindowFill;
+    // Bytes left to read in a stored block
+    uint16_t iStoredLength;
+    // Bytes left to copy from earlier in the data, and how far back
+    uint16_t iCopyLength;
+    uint16_t iCopyDistance;
+    // Huffman codes for the current block, stored as the number of codes of
+    // each length followed by the symbols in code order.  Whilst a dynamic
+    // block's codes are being read iLiteralSymbols holds their lengths
+    uint16_t iLiteralCounts[kMaxCodeLength+1];
+    uint16_t iLiteralSymbols[kMaxLiteralSymbols];
+    uint16_t iDistanceCounts[kMaxCodeLength+1];
+    uint16_t iDistanceSymbols[kMaxDistanceSymbols];
+};
+
+#endif
@@ -4,6 +4,15 @@
 
 #include "URLEncoder.h"
 
+// Bit (c & 7) of byte (c >> 3) is set for A-Z, a-z, 0-9 and "-._~"
+const uint8_t URLEncoderClass::kUnreserved[32] PROGMEM = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0xff, 0x03,
+    0xfe, 0xff, 0xff, 0x87, 0xfe, 0xff, 0xff, 0x47,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+const char URLEncoderClass::kHexDigits[] = "0123456789ABCDEF";
+
 URLEncoderClass::URLEncoderClass()
 {
 }
@@ -26,28 +35,141 @@ String URLEncoderClass::encode(const char* str, int length)
 {
     String encoded;
 
-    encoded.reserve(length);
+    encoded.reserve(encodedLength(str, length));
+
+    while (length > 0) {
+        size_t run = unreservedRun(str, length);
+
+        if (run > 0) {
+            // A character at a time, as some cores don't make
+            // concat(const char*, unsigned int) public.  The reserve()
+            // above means it doesn't reallocate
+            length -= run;
+            while (run--) {
+                encoded.concat(*str++);
+            }
+            continue;
+        }
+
+        char s[4];
+
+        s[0] = '%';
+        s[1] = kHexDigits[((uint8_t)*str >> 4) & 0xf];
+        s[2] = kHexDigits[*str & 0xf];
+        s[3] = 0;
+
+        encoded += s;
+        str++;
+        length--;
+    }
+
+    return encoded;
+}
+
+size_t URLEncoderClass::encode(Print& aOutput, const char* str)
+{
+    return encode(aOutput, str, strlen(str));
+}
+
+size_t URLEncoderClass::encode(Print& aOutput, const char* str, size_t length)
+{
+    size_t written = 0;
+
+    while (length > 0) {
+        size_t run = unreservedRun(str, length);
+
+        if (run > 0) {
+            size_t count = aOutput.write((const uint8_t*)str, run);
+
+            written += count;
+            if (count != run) {
+                // It won't take any more
+                break;
+            }
+            str += run;
+            length -= run;
+            continue;
+        }
+
+        uint8_t escape[3];
+
+        escape[0] = '%';
+        escape[1] = kHexDigits[((uint8_t)*str >> 4) & 0xf];
+        escape[2] = kHexDigits[*str & 0xf];
 
-    for (int i = 0; i < length; i++) {
-        char c = str[i];
+        size_t count = aOutput.write(escape, sizeof(escape));
 
-        const char HEX_DIGIT_MAPPER[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+        written += count;
+        if (count != sizeof(escape)) {
+            break;
+        }
+        str++;
+        length--;
+    }
+
+    return written;
+}
+
+size_t URLEncoderClass::encode(const char* str, char* aBuffer, size_t aSize)
+{
+    size_t pos = 0;
 
-        if (isAlphaNumeric(c) || (c == '-') || (c == '.') || (c == '_') || (c == '~')) {
-            encoded += c;
+    for (; *str; str++) {
+        uint8_t c = *str;
+
+        if (isUnreserved(c)) {
+            if (pos + 1 < aSize) {
+                aBuffer[pos] = c;
+            }
+            pos++;
         } else {
-            char s[4];
+            // Only put in a whole escape, never part of one
+            if (pos + 3 < aSize) {
+                aBuffer[pos] = '%';
+                aBuffer[pos + 1] = kHexDigits[c >> 4];
+                aBuffer[pos + 2] = kHexDigits[c & 0xf];
+            } else if (pos < aSize) {
+                // Make sure nothing else goes in after it either
+                aSize = pos + 1;
+            }
+            pos += 3;
+        }
+    }
+
+    if (aSize > 0) {
+        aBuffer[(pos < aSize) ? pos : aSize - 1] = '\0';
+    }
+    return pos;
+}
+
+size_t URLEncoderClass::encodedLength(const char* str)
+{
+    return encodedLength(str, strlen(str));
+}
 
-            s[0] = '%';
-            s[1] = HEX_DIGIT_MAPPER[(c >> 4) & 0xf];
-            s[2] = HEX_DIGIT_MAPPER[(c & 0x0f)];
-            s[3] = 0;
+size_t URLEncoderClass::encodedLength(const char* str, size_t length)
+{
+    size_t encoded = length;
 
-            encoded += s;
+    for (size_t i = 0; i < length; i++) {
+        if (!isUnreserved(str[i])) {
+            // "%XX" instead of the character itself
+            encoded += 2;
         }
     }
 
     return encoded;
 }
 
+size_t URLEncoderClass::unreservedRun(const char* str, size_t length)
+{
+    size_t run = 0;
+
+    while ((run < length) && isUnreserved(str[run])) {
+        run++;
+    }
+
+    return run;
+}
+
 URLEncoderClass URLEncoder;
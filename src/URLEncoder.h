@@ -16,8 +16,47 @@ public:
     static String encode(const char* str);
     static String encode(const String& str);
 
+    /** Write str, URL-encoded, straight to aOutput.  Runs of characters
+      that don't need encoding are written in one go
+      @return Number of bytes written
+    */
+    static size_t encode(Print& aOutput, const char* str);
+    static size_t encode(Print& aOutput, const char* str, size_t length);
+
+    /** URL-encode str into aBuffer, which is always '\0' terminated as long
+      as aSize isn't 0.  Like snprintf(), the whole encoded length is
+      returned even if it didn't all fit, so the result was truncated if
+      it's aSize or more
+      @param aBuffer  Where to put the result
+      @param aSize    Size of aBuffer, including space for the '\0'
+      @return Length of str once it's encoded, not counting the '\0'
+    */
+    static size_t encode(const char* str, char* aBuffer, size_t aSize);
+
+    /** Return how long str will be once it's URL-encoded, e.g. to work out
+      a Content-Length or the size of buffer needed
+    */
+    static size_t encodedLength(const char* str);
+    static size_t encodedLength(const char* str, size_t length);
+
 private:
     static String encode(const char* str, int length);
+
+    /* Return whether c can go in a URL as it is, i.e. it's a letter, a
+      digit or one of "-._~"
+    */
+    static bool isUnreserved(uint8_t c)
+      { return pgm_read_byte(&kUnreserved[c >> 3]) & (1 << (c & 7)); };
+
+    /* Return how many characters at the start of str, up to length of them,
+      can go in a URL as they are
+    */
+    static size_t unreservedRun(const char* str, size_t length);
+
+    // One bit for each character, set if it doesn't need encoding.  It's in
+    // flash, so use isUnreserved() to read it
+    static const uint8_t kUnreserved[32];
+    static const char kHexDigits[];
 };
 
 extern URLEncoderClass URLEncoder;
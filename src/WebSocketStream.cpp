@@ -8,7 +8,10 @@
 WebSocketStream::WebSocketStream(Stream& aStream)
  : HttpStream(aStream),
    iTxStarted(false),
-   iRxSize(0)
+   iRxSize(0),
+   iRxMasked(false),
+   iRxMaskIndex(0),
+   iRxHeaderLength(0)
 {
 }
 
@@ -47,6 +50,7 @@ int WebSocketStream::begin(const char* aPath)
     }
 
     iRxSize = 0;
+    iRxHeaderLength = 0;
 
     // status code of 101 means success
     return (status == 101) ? 0 : status;
@@ -165,18 +169,40 @@ size_t WebSocketStream::write(const uint8_t *aBuffer, size_t aSize)
 
 int WebSocketStream::parseMessage()
 {
-    flushRx();
+    return nextMessage() ? (int)iRxSize : 0;
+}
 
-    // make sure 2 bytes (opcode + length)
-    // are available
-    if (HttpStream::available() < 2)
+bool WebSocketStream::nextMessage()
+{
+    // skip what's left of the last message, without waiting for it
+    if (!flushRx())
     {
-        return 0;
+        return false;
+    }
+
+    // take in the frame header as it arrives, opcode and length first, as
+    // they give how much more of it there is
+    while (iRxHeaderLength < rxHeaderLength())
+    {
+        if (HttpStream::available() <= 0)
+        {
+            return false;
+        }
+
+        int c = HttpStream::read();
+
+        if (c < 0)
+        {
+            return false;
+        }
+        iRxHeader[iRxHeaderLength++] = c;
     }
 
-    // read open code and length
-    uint8_t opcode = HttpStream::read();
-    int length = HttpStream::read();
+    const uint8_t* header = iRxHeader;
+    uint8_t opcode = *header++;
+    int length = *header++;
+
+    iRxHeaderLength = 0;
 
     if ((opcode & 0x0f) == 0)
     {
@@ -196,29 +222,21 @@ int WebSocketStream::parseMessage()
     {
         iRxSize = length;
     }
-    else if (length == 126)
-    {
-        iRxSize = (HttpStream::read() << 8) | HttpStream::read();
-    }
     else
     {
-        iRxSize = ((uint64_t)HttpStream::read() << 56) | 
-                    ((uint64_t)HttpStream::read() << 48) | 
-                    ((uint64_t)HttpStream::read() << 40) | 
-                    ((uint64_t)HttpStream::read() << 32) | 
-                    ((uint64_t)HttpStream::read() << 24) | 
-                    ((uint64_t)HttpStream::read() << 16) | 
-                    ((uint64_t)HttpStream::read() << 8)  |
-                    (uint64_t)HttpStream::read(); 
+        int lengthBytes = (length == 126) ? 2 : 8;
+
+        iRxSize = 0;
+        for (int i = 0; i < lengthBytes; i++)
+        {
+            iRxSize = (iRxSize << 8) | *header++;
+        }
     }
 
     // read in the mask, if present
     if (iRxMasked)
     {
-        for (int i = 0; i < (int)sizeof(iRxMaskKey); i++)
-        {
-            iRxMaskKey[i] = HttpStream::read();
-        }
+        memcpy(iRxMaskKey, header, sizeof(iRxMaskKey));
     }
 
     iRxMaskIndex = 0;
@@ -226,7 +244,7 @@ int WebSocketStream::parseMessage()
     if (TYPE_CONNECTION_CLOSE == messageType())
     {
         flushRx();
-        iRxSize = 0;
+        return false;
     }
     else if (TYPE_PING == messageType())
     {
@@ -238,14 +256,15 @@ int WebSocketStream::parseMessage()
         endMessage();
 
         iRxSize = 0;
+        return false;
     }
     else if (TYPE_PONG == messageType())
     {
         flushRx();
-        iRxSize = 0;
+        return false;
     }
 
-    return iRxSize;
+    return true;
 }
 
 int WebSocketStream::messageType()
@@ -320,15 +339,32 @@ int WebSocketStream::read(uint8_t *aBuffer, size_t aSize)
     if (readCount > 0)
     {
         iRxSize -= readCount;
+        unmask(aBuffer, readCount);
+    }
 
-        // unmask the RX data if needed
-        if (iRxMasked)
-        {
-            for (int i = 0; i < (int)aSize; i++, iRxMaskIndex++)
-            {
-                aBuffer[i] ^= iRxMaskKey[iRxMaskIndex % sizeof(iRxMaskKey)];
-            }
-        }
+    return readCount;
+}
+
+int WebSocketStream::readAvailable(uint8_t *aBuffer, size_t aSize)
+{
+    if (iRxSize == 0)
+    {
+        // Nothing more of this message
+        return 0;
+    }
+
+    if (aSize > iRxSize)
+    {
+        // Don't run into the next frame's header
+        aSize = (size_t)iRxSize;
+    }
+
+    int readCount = HttpStream::readAvailable(aBuffer, aSize);
+
+    if (readCount > 0)
+    {
+        iRxSize -= readCount;
+        unmask(aBuffer, readCount);
     }
 
     return readCount;
@@ -347,10 +383,55 @@ int WebSocketStream::peek()
     return p;
 }
 
-void WebSocketStream::flushRx()
+void WebSocketStream::unmask(uint8_t *aBuffer, int aCount)
+{
+    // unmask the RX data if needed
+    if (iRxMasked)
+    {
+        for (int i = 0; i < aCount; i++, iRxMaskIndex++)
+        {
+            aBuffer[i] ^= iRxMaskKey[iRxMaskIndex % sizeof(iRxMaskKey)];
+        }
+    }
+}
+
+int WebSocketStream::rxHeaderLength()
+{
+    if (iRxHeaderLength < 2)
+    {
+        return 2;
+    }
+
+    int length = iRxHeader[1] & 0x7f;
+    int headerLength = 2;
+
+    if (length == 126)
+    {
+        headerLength += 2;
+    }
+    else if (length == 127)
+    {
+        headerLength += 8;
+    }
+    if (iRxHeader[1] & 0x80)
+    {
+        headerLength += sizeof(iRxMaskKey);
+    }
+
+    return headerLength;
+}
+
+bool WebSocketStream::flushRx()
 {
-    while(available())
+    uint8_t discard[16];
+
+    while (iRxSize > 0)
     {
-        read();
+        if (readAvailable(discard, sizeof(discard)) <= 0)
+        {
+            return false;
+        }
     }
+
+    return true;
 }
@@ -44,6 +44,14 @@ public:
     */
     int parseMessage();
 
+    /** Try to parse an incoming message, as parseMessage() does, but
+        telling an empty message apart from none yet.  Only returns true
+        once all of the message's frame header has arrived
+      @return true if a message has started, when available() gives its
+              size, false if there isn't one yet
+    */
+    bool nextMessage();
+
     /** Returns type of current parsed message
       @return type of current parsedMessage (TYPE_TEXT or TYPE_BINARY)
     */
@@ -76,9 +84,13 @@ public:
     virtual int read();
     virtual int read(uint8_t *buf, size_t size);
     virtual int peek();
+    // Inherited from HttpStream
+    virtual int readAvailable(uint8_t *aBuffer, size_t aSize);
 
 private:
-    void flushRx();
+    int rxHeaderLength();
+    bool flushRx();
+    void unmask(uint8_t *aBuffer, int aCount);
 
 private:
     bool iTxStarted;
@@ -91,6 +103,9 @@ private:
     bool iRxMasked;
     int iRxMaskIndex;
     uint8_t iRxMaskKey[4];
+    // Frame header taken in so far: opcode, length, extended length and mask
+    uint8_t iRxHeader[14];
+    uint8_t iRxHeaderLength;
 };
 
 #endif